@@ -14,6 +14,31 @@
 //#include "tmx_bond.h"
 //#include "tmx_bootstrap.h"
 //#include "tmx_muni.h"
+#include "tmx_parallel.h"
+#include "tmx_cash_flow_index.h"
+#include "tmx_scheduler.h"
+#include "tmx_graph.h"
+#include "tmx_analytics.h"
+#include "tmx_curve_handle.h"
+#include "tmx_result_cache.h"
+#include "tmx_registry.h"
+#include "tmx_feed.h"
+#include "tmx_batcher.h"
+#include "tmx_shm.h"
+#include "tmx_scenario.h"
+#include "tmx_ho_lee.h"
+#include "tmx_lattice.h"
+#include "tmx_callable.h"
+#include "tmx_make_whole.h"
+#include "tmx_option_bachelier.h"
+#include "tmx_math_dual.h"
+#include "tmx_sabr.h"
+#include "tmx_cap.h"
+#include "tmx_variate_stream.h"
+#include "tmx_exposure.h"
+#include "tmx_ytw.h"
+#include "tmx_mbs.h"
+#include "tmx_futures.h"
  
 using namespace fms;
 using namespace tmx;
@@ -36,7 +61,7 @@ int test_variate_normal = variate::normal<>::test();
 //int test_black_put = black::put::test();
 int test_curve_operator = curve_operator_test();
 //int test_pwflat = curve::pwflat_test();
-//int test_option_put = option::put::test();
+int test_option_put = option::put::test();
 //>>>>>>> main
 //int test_date_periodic = date::periodic_test();
 //int test_datetime = datetime::test();
@@ -51,6 +76,37 @@ int test_curve_operator = curve_operator_test();
 //int test_bond_basic = bond::basic_test();
 //int test_bootstrap_instrument = bootstrap::instrument_test();
 //int test_muni_fit = muni::fit_test();
+int test_parallel_for_chunks = parallel::for_chunks_test();
+int test_cash_flow_index = cash_flow::index<>::test();
+int test_scheduler_pool = scheduler::pool_test();
+int test_graph_dag = graph::dag_test();
+int test_analytics_cache = analytics::cache<>::test();
+int test_curve_handle = curve::handle<>::test();
+int test_result_cache = result::cache<>::test();
+int test_registry_index = registry::index::test();
+int test_feed = feed::feed_test();
+int test_batch_batcher = batch::batcher_test();
+#ifndef _WIN32
+int test_shm = shm::shm_test();
+#endif // _WIN32
+int test_scenario = scenario::scenario_test();
+int test_ho_lee_jamshidian = ho_lee::jamshidian_test();
+int test_ho_lee_jamshidian_greeks = ho_lee::jamshidian_greeks_test();
+int test_lattice_ho_lee = lattice::ho_lee_test();
+int test_lattice_hull_white = lattice::hull_white_test();
+int test_callable_value = callable::value_test();
+int test_make_whole_value = make_whole::value_test();
+int test_option_bachelier = option::bachelier::test();
+int test_math_dual = math::dual_test();
+int test_sabr = sabr::test();
+int test_pwflat_integral_batch = pwflat::integral_batch_test();
+int test_cap_value = cap::value_test();
+int test_variate_stream = variate::stream::test();
+int test_exposure_run = exposure::run_test();
+int test_lattice_oas = lattice::oas_test();
+int test_ytw_worst = ytw::worst_test();
+int test_mbs_value = mbs::value_test();
+int test_futures_analyze = futures::analyze_test();
 #endif // _DEBUG
 
 int main()
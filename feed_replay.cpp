@@ -0,0 +1,160 @@
+// feed_replay.cpp - Replay a quote capture through the quote to yield path.
+// feed_replay generate <file> [quotes] [instruments]  write a synthetic capture
+// feed_replay <file> [speed] [consumers]             replay, speed 0 is max speed
+// feed_replay serve <file> <socket>                  send a capture to the first client of a local socket
+// feed_replay connect <socket> <instruments> [speed] [consumers]  replay quotes read from a local socket
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "tmx_feed.h"
+
+using namespace tmx;
+
+// Semiannual 5% bond maturing in 1 + id % 30 years.
+static analytics::cache<> bond(uint32_t id)
+{
+	const size_t m = 2 * (1 + id % 30);
+	std::vector<double> u(m), c(m, 0.025);
+	for (size_t j = 0; j < m; ++j) {
+		u[j] = 0.5 * (j + 1);
+	}
+	c.back() += 1;
+
+	return analytics::cache<>(m, u.data(), c.data(), 0.05);
+}
+
+static double price(const analytics::cache<>& b, double y)
+{
+	double p = 0;
+	for (size_t j = 0; j < b.size(); ++j) {
+		p += b.cash()[j] * std::exp(-y * b.time()[j]);
+	}
+
+	return p;
+}
+
+// Replay source into a book of k bonds and report throughput.
+template<class Source>
+static void run(Source& s, uint32_t k, double speed, unsigned consumers)
+{
+	std::vector<analytics::cache<>> b;
+	for (uint32_t id = 0; id < k; ++id) {
+		b.push_back(bond(id));
+	}
+
+	feed::yields sink(b);
+	feed::handler h(std::ref(sink), consumers);
+	const auto t0 = std::chrono::steady_clock::now();
+	const size_t n = h.run(s, speed);
+	const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+	std::cout << n << " quotes, " << k << " instruments, " << dt.count() << " s, "
+	          << n / dt.count() << " quotes/s\n";
+}
+
+int main(int ac, char* av[])
+{
+	if (ac < 2) {
+		std::cerr << "usage: feed_replay generate <file> [quotes] [instruments]\n"
+		          << "       feed_replay <file> [speed] [consumers]\n"
+		          << "       feed_replay serve <file> <socket>\n"
+		          << "       feed_replay connect <socket> <instruments> [speed] [consumers]\n";
+		return 1;
+	}
+
+	try {
+		if (std::string(av[1]) == "generate") {
+			if (ac < 3) {
+				std::cerr << "feed_replay: missing capture file\n";
+				return 1;
+			}
+			const size_t n = ac > 3 ? std::stoul(av[3]) : 1'000'000;
+			const uint32_t k = ac > 4 ? static_cast<uint32_t>(std::stoul(av[4])) : 10'000;
+			if (k == 0) {
+				std::cerr << "feed_replay: instruments must be positive\n";
+				return 1;
+			}
+			std::vector<analytics::cache<>> b;
+			for (uint32_t id = 0; id < k; ++id) {
+				b.push_back(bond(id));
+			}
+			std::vector<feed::quote> qs(n);
+			uint64_t x = 1;
+			for (size_t i = 0; i < n; ++i) {
+				x = x * 6364136223846793005ull + 1442695040888963407ull; // LCG
+				const uint32_t id = static_cast<uint32_t>((x >> 33) % k);
+				const double y = 0.05 + 0.0001 * (static_cast<double>((x >> 20) % 200) - 100) / 100;
+				qs[i] = feed::quote{ static_cast<int64_t>(i) * 1000, id, 0, price(b[id], y) };
+			}
+			feed::capture::write(av[2], qs.size(), qs.data());
+			std::cout << "wrote " << n << " quotes for " << k << " instruments to " << av[2] << "\n";
+
+			return 0;
+		}
+
+#ifndef _WIN32
+		if (std::string(av[1]) == "serve") {
+			if (ac < 4) {
+				std::cerr << "feed_replay: missing capture file or socket\n";
+				return 1;
+			}
+			std::vector<feed::quote> qs;
+			{
+				feed::capture s(av[2]);
+				feed::quote q;
+				while (s.next(q)) {
+					qs.push_back(q);
+				}
+			}
+			feed::listener l(av[3]);
+			const auto c = l.accept();
+			if (!c->write(qs.size(), qs.data())) {
+				std::cerr << "feed_replay: client went away\n";
+				return 1;
+			}
+			std::cout << "sent " << qs.size() << " quotes to " << av[3] << "\n";
+
+			return 0;
+		}
+		if (std::string(av[1]) == "connect") {
+			if (ac < 4) {
+				std::cerr << "feed_replay: missing socket or instruments\n";
+				return 1;
+			}
+			const uint32_t k = static_cast<uint32_t>(std::stoul(av[3]));
+			const double speed = ac > 4 ? std::stod(av[4]) : 0;
+			const unsigned consumers = ac > 5 ? static_cast<unsigned>(std::stoul(av[5])) : 1;
+
+			feed::socket s(av[2]);
+			run(s, k, speed, consumers);
+
+			return 0;
+		}
+#endif // _WIN32
+
+		const double speed = ac > 2 ? std::stod(av[2]) : 0;
+		const unsigned consumers = ac > 3 ? static_cast<unsigned>(std::stoul(av[3])) : 1;
+
+		// size the book from the largest id in the capture
+		uint32_t k = 0;
+		{
+			feed::capture s(av[1]);
+			feed::quote q;
+			while (s.next(q)) {
+				k = std::max(k, q.id + 1);
+			}
+		}
+
+		feed::capture s(av[1]);
+		run(s, k, speed, consumers);
+	}
+	catch (const std::exception& ex) {
+		std::cerr << ex.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+// tmx_analytics.h - Incremental per-bond yield and spread.
+// A bond's curve discounts D(u_j) and its last solved yield and spread are
+// cached. A price tick then costs one or two Newton steps started from the
+// previous solution, each a single pass over the cash flows computing value
+// and derivative together. A curve change only replaces the discounts.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <cmath>
+#include <vector>
+#include "ensure.h"
+#include "tmx_math.h"
+#include "tmx_curve.h"
+
+namespace tmx::analytics {
+
+	template<class U = double, class C = double>
+	class cache {
+		std::vector<U> u;
+		std::vector<C> c;
+		std::vector<C> w; // c[j] D(u[j]) for the current curve, empty if none
+		C y, s;           // last solved yield and spread
+		C tol;
+		unsigned iter;
+		unsigned n = 0;   // Newton steps taken by last solve
+
+		// Newton on p = sum_j a[j] exp(-x u[j]) starting at x.
+		C solve(const C* a, C p, C x)
+		{
+			for (n = 1; n <= iter; ++n) {
+				C v = 0, dv = 0;
+				for (size_t j = 0; j < u.size(); ++j) {
+					const C e = a[j] * std::exp(-x * u[j]);
+					v += e;
+					dv -= u[j] * e;
+				}
+				const C dx = (v - p) / dv;
+				x -= dx;
+				if (math::fabs(dx) <= tol) {
+					return x;
+				}
+			}
+
+			return math::NaN<C>;
+		}
+	public:
+		// Cash flows c[j] at times u[j] > 0 from valuation.
+		cache(size_t m, const U* u, const C* c, C y = 0.01, C s = 0,
+			C tol = math::sqrt_epsilon<C>, unsigned iter = 100)
+			: u(u, u + m), c(c, c + m), y(y), s(s), tol(tol), iter(iter)
+		{ }
+		cache(const cache&) = default;
+		cache& operator=(const cache&) = default;
+		cache(cache&&) = default;
+		cache& operator=(cache&&) = default;
+		~cache() = default;
+
+		size_t size() const
+		{
+			return u.size();
+		}
+		const U* time() const
+		{
+			return u.data();
+		}
+		const C* cash() const
+		{
+			return c.data();
+		}
+
+		// Cache discounts of a new curve. The last yield and spread are kept as starting points.
+		template<class T, class F>
+		cache& curve(const curve::base<T, F>& f)
+		{
+			w.resize(u.size());
+			for (size_t j = 0; j < u.size(); ++j) {
+				w[j] = c[j] * f.discount(u[j]);
+			}
+
+			return *this;
+		}
+		// Drop cached discounts.
+		cache& invalidate()
+		{
+			w.clear();
+
+			return *this;
+		}
+		bool has_curve() const
+		{
+			return w.size() == u.size() && !u.empty();
+		}
+
+		// Constant forward rate y with p = sum_j c[j] exp(-y u[j]).
+		C yield(C p)
+		{
+			const C y_ = solve(c.data(), p, y);
+			if (!std::isnan(y_)) {
+				y = y_;
+			}
+
+			return y_;
+		}
+		// Constant spread s with p = sum_j c[j] D(u[j]) exp(-s u[j]) over the cached curve.
+		C spread(C p)
+		{
+			ensure(has_curve());
+
+			const C s_ = solve(w.data(), p, s);
+			if (!std::isnan(s_)) {
+				s = s_;
+			}
+
+			return s_;
+		}
+
+		// Last solved values.
+		C yield() const
+		{
+			return y;
+		}
+		C spread() const
+		{
+			return s;
+		}
+		// Newton steps used by the last solve.
+		unsigned steps() const
+		{
+			return n;
+		}
+
+#ifdef _DEBUG
+		static int test()
+		{
+			const U u[] = { 0.5, 1, 1.5, 2, 2.5, 3 };
+			const C c[] = { 0.025, 0.025, 0.025, 0.025, 0.025, 1.025 };
+			const auto price = [&](C x, const curve::base<U, C>& f) {
+				C p = 0;
+				for (size_t j = 0; j < 6; ++j) {
+					p += c[j] * f.discount(u[j]) * std::exp(-x * u[j]);
+				}
+				return p;
+			};
+			const curve::constant<U, C> zero(0);
+			{
+				cache b(6, u, c);
+				C y = b.yield(price(C(0.05), zero));
+				assert(math::fabs(y - C(0.05)) <= math::sqrt_epsilon<C>);
+				// price tick of about one basis point
+				y = b.yield(price(C(0.0501), zero));
+				assert(math::fabs(y - C(0.0501)) <= math::sqrt_epsilon<C>);
+				assert(b.steps() <= 2);
+				assert(!b.has_curve());
+			}
+			{
+				curve::constant<U, C> f(C(0.04));
+				cache b(6, u, c);
+				b.curve(f);
+				C s = b.spread(price(C(0.01), f));
+				assert(math::fabs(s - C(0.01)) <= math::sqrt_epsilon<C>);
+				s = b.spread(price(C(0.0101), f));
+				assert(math::fabs(s - C(0.0101)) <= math::sqrt_epsilon<C>);
+				assert(b.steps() <= 2);
+
+				// curve moves, price does not
+				const C p = price(C(0.0101), f);
+				f.extrapolate(C(0.041));
+				b.curve(f);
+				s = b.spread(p);
+				assert(math::fabs(s - C(0.0091)) <= math::sqrt_epsilon<C>);
+				assert(b.yield() == C(0.01)); // untouched
+
+				b.invalidate();
+				assert(!b.has_curve());
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+} // namespace tmx::analytics
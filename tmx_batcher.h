@@ -0,0 +1,315 @@
+// tmx_batcher.h - Adaptive batching in front of pricing kernels.
+// Requests queue until the batch is full or the oldest request has waited
+// for the flush timeout. After every window of requests the batcher
+// compares the observed p99 latency with the target and re-plans:
+//   timeout = headroom * target - service time of a full batch
+//   size    = arrival rate * timeout
+// Headroom shrinks when p99 is over target and grows back when well under.
+// Decisions and observations are published in batch::counters.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <future>
+#include "tmx_option.h"
+#endif // _DEBUG
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tmx::batch {
+
+	// Instrumentation counters.
+	struct counters {
+		std::atomic<uint64_t> requests = 0;
+		std::atomic<uint64_t> batches = 0;
+		std::atomic<uint64_t> full = 0;    // flushes because the batch was full
+		std::atomic<uint64_t> timeout = 0; // flushes because the oldest request waited too long
+		std::atomic<uint64_t> grow = 0;    // re-plans that increased the batch size
+		std::atomic<uint64_t> shrink = 0;  // re-plans that decreased the batch size
+		std::atomic<size_t> size = 0;      // current batch size
+		std::atomic<int64_t> wait_ns = 0;  // current flush timeout
+		std::atomic<int64_t> p99_ns = 0;   // last observed p99 latency
+		std::atomic<double> rate = 0;      // arrivals per second
+	};
+
+	template<class Req, class Res>
+	class batcher {
+	public:
+		using clock = std::chrono::steady_clock;
+		using kernel = std::function<void(size_t, const Req*, Res*)>;
+		using callback = std::function<void(const Res&)>;
+
+		struct options {
+			std::chrono::nanoseconds target = std::chrono::microseconds(500); // p99 latency target
+			size_t min_size = 1;
+			size_t max_size = 4096;
+			size_t window = 1024; // requests per re-plan
+		};
+	private:
+		kernel f;
+		options o;
+		counters c;
+
+		std::mutex m;
+		std::condition_variable cv;
+		std::vector<Req> req;
+		std::vector<callback> cb;
+		std::vector<clock::time_point> arrival;
+		bool stop = false;
+
+		// planner state, flusher thread only
+		size_t size;
+		clock::duration wait;
+		double headroom = 0.5;
+		double per_item = 0, per_batch = 0; // service time model in ns
+		std::vector<int64_t> lat;           // latencies in current window
+		clock::time_point window_start;
+		uint64_t window_requests = 0;
+
+		std::thread t;
+
+		void plan()
+		{
+			if (lat.empty()) {
+				return;
+			}
+			const size_t k = std::min(lat.size() - 1, (lat.size() * 99) / 100);
+			std::nth_element(lat.begin(), lat.begin() + k, lat.end());
+			const int64_t p99 = lat[k];
+			lat.clear();
+
+			const auto now = clock::now();
+			const double dt = std::chrono::duration<double>(now - window_start).count();
+			const double rate = dt > 0 ? window_requests / dt : 0;
+			window_start = now;
+			window_requests = 0;
+
+			const double target = static_cast<double>(o.target.count());
+			if (p99 > target) {
+				headroom = std::max(0.05, headroom * 0.8);
+			}
+			else if (p99 < 0.7 * target) {
+				headroom = std::min(0.9, headroom * 1.1);
+			}
+			// timeout leaves room to serve a full batch within the target
+			const double service = per_batch + per_item * static_cast<double>(size);
+			const double wait_ns = std::max(0., headroom * target - service);
+			const size_t size_ = std::clamp(static_cast<size_t>(rate * wait_ns * 1e-9), o.min_size, o.max_size);
+
+			c.grow += size_ > size;
+			c.shrink += size_ < size;
+			size = size_;
+			wait = std::chrono::nanoseconds(static_cast<int64_t>(wait_ns));
+			c.size = size;
+			c.wait_ns = static_cast<int64_t>(wait_ns);
+			c.p99_ns = p99;
+			c.rate = rate;
+		}
+
+		void loop()
+		{
+			std::vector<Req> req_;
+			std::vector<callback> cb_;
+			std::vector<clock::time_point> arrival_;
+			std::vector<Res> res;
+
+			while (true) {
+				{
+					std::unique_lock lock(m);
+					cv.wait(lock, [this] { return stop || !req.empty(); });
+					if (req.empty()) {
+						return;
+					}
+					const auto due = arrival.front() + wait;
+					const bool full = cv.wait_until(lock, due, [this] { return stop || req.size() >= size; }) && !stop;
+					++(full ? c.full : c.timeout);
+					const size_t n = std::min(req.size(), size);
+					req_.assign(req.begin(), req.begin() + n);
+					cb_.assign(cb.begin(), cb.begin() + n);
+					arrival_.assign(arrival.begin(), arrival.begin() + n);
+					req.erase(req.begin(), req.begin() + n);
+					cb.erase(cb.begin(), cb.begin() + n);
+					arrival.erase(arrival.begin(), arrival.begin() + n);
+				}
+
+				const size_t n = req_.size();
+				res.resize(n);
+				const auto t0 = clock::now();
+				f(n, req_.data(), res.data());
+				const auto t1 = clock::now();
+				for (size_t i = 0; i < n; ++i) {
+					if (cb_[i]) {
+						cb_[i](res[i]);
+					}
+				}
+				++c.batches;
+
+				// service time model, exponentially weighted
+				const double s = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+				const double item = s / static_cast<double>(n);
+				per_item = per_item == 0 ? item : 0.9 * per_item + 0.1 * item;
+				per_batch = 0.9 * per_batch + 0.1 * std::max(0., s - per_item * static_cast<double>(n));
+
+				for (const auto& a : arrival_) {
+					lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - a).count());
+				}
+				window_requests += n;
+				if (lat.size() >= o.window) {
+					plan();
+				}
+			}
+		}
+	public:
+		batcher(kernel f, options o = options{})
+			: f(std::move(f)), o(o), size(o.min_size), wait(o.target / 4), window_start(clock::now())
+		{
+			c.size = size;
+			c.wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+			t = std::thread([this] { loop(); });
+		}
+		batcher(const batcher&) = delete;
+		batcher& operator=(const batcher&) = delete;
+		// Flush queued requests and stop.
+		~batcher()
+		{
+			{
+				std::lock_guard lock(m);
+				stop = true;
+			}
+			cv.notify_all();
+			t.join();
+		}
+
+		// Queue a request. done is called on the batcher thread with the result.
+		void submit(const Req& r, callback done = nullptr)
+		{
+			{
+				std::lock_guard lock(m);
+				req.push_back(r);
+				cb.push_back(std::move(done));
+				arrival.push_back(clock::now());
+			}
+			++c.requests;
+			cv.notify_one();
+		}
+
+		const counters& stats() const
+		{
+			return c;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int batcher_test()
+	{
+		struct black {
+			double f, s, k;
+		};
+		// requests to columns for the vectorized Black kernel
+		const auto kernel = [](size_t n, const black* r, double* v) {
+			std::vector<double> f(n), s(n), k(n);
+			for (size_t i = 0; i < n; ++i) {
+				f[i] = r[i].f;
+				s[i] = r[i].s;
+				k[i] = r[i].k;
+			}
+			option::call::value(n, f.data(), s.data(), k.data(), v);
+		};
+		const auto req = [](int i) {
+			return black{ 100, 0.1 + 0.01 * (i % 20), 80. + i % 41 };
+		};
+		{
+			// full batches queued while the flusher is held in the kernel
+			std::promise<void> entered, release;
+			auto released = release.get_future().share();
+			bool first = true;
+			batcher<black, double>::options o;
+			o.min_size = o.max_size = 64;
+			std::atomic<size_t> done = 0;
+			std::atomic<bool> bad = false;
+			{
+				batcher<black, double> b([&](size_t n, const black* r, double* v) {
+					if (first) {
+						first = false;
+						entered.set_value();
+						released.wait();
+					}
+					kernel(n, r, v);
+				}, o);
+				const auto check = [&](int i) {
+					return [&, i](double x) {
+						const black r = req(i);
+						bad = bad || math::fabs(x - option::call::value(r.f, r.s, r.k)) > 1e-12;
+						++done;
+					};
+				};
+				b.submit(req(0), check(0));
+				entered.get_future().wait();
+				for (int i = 1; i <= 64 * 10; ++i) {
+					b.submit(req(i), check(i));
+				}
+				release.set_value();
+				while (done < 641) {
+					std::this_thread::yield();
+				}
+				const auto& c = b.stats();
+				assert(641 == c.requests);
+				assert(11 == c.batches);
+				assert(10 == c.full && 1 == c.timeout);
+			}
+			assert(!bad);
+		}
+		{
+			// adaptive plan under a paced load
+			std::atomic<size_t> done = 0;
+			std::atomic<bool> bad = false;
+			{
+				batcher<black, double>::options o;
+				o.target = std::chrono::microseconds(200);
+				o.window = 256;
+				batcher<black, double> b(kernel, o);
+				for (int i = 0; i < 5000; ++i) {
+					const black r = req(i);
+					const double v = option::call::value(r.f, r.s, r.k);
+					b.submit(r, [&, v](double x) {
+						bad = bad || math::fabs(x - v) > 1e-12;
+						++done;
+					});
+					if (i % 8 == 0) {
+						std::this_thread::sleep_for(std::chrono::microseconds(20));
+					}
+				}
+				while (done < 5000) {
+					std::this_thread::yield();
+				}
+				const auto& c = b.stats();
+				assert(5000 == c.requests);
+				assert(c.batches == c.full + c.timeout);
+				assert(c.size >= o.min_size && c.size <= o.max_size);
+				assert(c.rate > 0);
+			}
+			assert(!bad);
+		}
+		{
+			// destructor flushes
+			std::atomic<size_t> done = 0;
+			{
+				batcher<black, double> b(kernel);
+				for (int i = 0; i < 10; ++i) {
+					b.submit({ 100, 0.2, 100 }, [&done](double) { ++done; });
+				}
+			}
+			assert(10 == done);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::batch
@@ -0,0 +1,173 @@
+// tmx_callable.h - Bonds with a single call at date and price under Ho-Lee.
+// The issuer may redeem at price p on the call date t after paying the coupon
+// due then, so the callable is the bullet less a call on the flows after t:
+//   V = sum_j c_j D(u_j) - jamshidian(u_j > t, t, p)
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include "tmx_lattice.h"
+#endif // _DEBUG
+#include <algorithm>
+#include <vector>
+#include "tmx_ho_lee.h"
+#include "tmx_parallel.h"
+
+namespace tmx::callable {
+
+	template<class U, class C, class T, class F>
+	inline F value(size_t m, const U* u, const C* c, const curve::base<T, F>& f, F σ, T t, F p)
+	{
+		F bullet = 0;
+		for (size_t j = 0; j < m; ++j) {
+			bullet += c[j] * f.discount(u[j]);
+		}
+
+		return bullet - ho_lee::jamshidian(m, u, c, f, t, σ, p);
+	}
+
+	// Book of n bonds. Bond i has flows u[o[i]..o[i + 1]), c[o[i]..o[i + 1]) and is callable at t[i] for p[i].
+	// Discounts are computed once per distinct flow or call date over the whole book.
+	// Bonds are priced in parallel chunks and the Black terms of a chunk go through one vectorized call.
+	// Put the value of the call in premium if not null.
+	template<class U, class C, class T, class F>
+	inline void value(size_t n, const size_t* o, const U* u, const C* c, const T* t, const C* p,
+		const curve::base<T, F>& f, F σ, F* v, F* premium = nullptr, unsigned threads = parallel::concurrency())
+	{
+		// shared date grid
+		std::vector<T> x(u, u + o[n]);
+		x.insert(x.end(), t, t + n);
+		std::sort(x.begin(), x.end());
+		x.erase(std::unique(x.begin(), x.end()), x.end());
+		std::vector<F> D(x.size());
+		parallel::for_each(x.size(), [&](size_t i) { D[i] = f.discount(x[i]); }, threads, 256);
+		const auto discount = [&x, &D](T s) {
+			return D[std::lower_bound(x.begin(), x.end(), s) - x.begin()];
+		};
+
+		parallel::for_chunks(n, [&](unsigned, size_t b, size_t e) {
+			std::vector<size_t> row(e - b + 1, 0);
+			for (size_t i = b; i < e; ++i) {
+				const size_t j0 = std::upper_bound(u + o[i], u + o[i + 1], t[i]) - u;
+				row[i - b + 1] = row[i - b] + (o[i + 1] - j0);
+			}
+			const size_t N = row[e - b];
+			std::vector<F> Du(N), fw(N), s(N), k(N), w(N);
+			std::vector<F> Dt(e - b), x_(e - b, F(0));
+			std::vector<bool> intrinsic(e - b, false);
+
+			for (size_t i = b; i < e; ++i) {
+				const size_t r = row[i - b];
+				const size_t m = row[i - b + 1] - r;
+				const size_t j0 = o[i + 1] - m;
+				Dt[i - b] = discount(t[i]);
+
+				F bullet = 0;
+				for (size_t j = o[i]; j < o[i + 1]; ++j) {
+					const F D_ = discount(u[j]);
+					bullet += c[j] * D_;
+					if (j >= j0) {
+						Du[r + j - j0] = D_;
+					}
+				}
+				v[i] = bullet;
+				intrinsic[i - b] = !ho_lee::jamshidian_terms(m, u + j0, c + j0, t[i], Dt[i - b], Du.data() + r, σ, F(p[i]),
+					fw.data() + r, s.data() + r, k.data() + r, x_[i - b]);
+			}
+
+			option::call::value(N, fw.data(), s.data(), k.data(), w.data());
+
+			for (size_t i = b; i < e; ++i) {
+				const size_t r = row[i - b];
+				const size_t m = row[i - b + 1] - r;
+				if (!intrinsic[i - b]) {
+					const size_t j0 = o[i + 1] - m;
+					F y = 0;
+					for (size_t l = r; l < r + m; ++l) {
+						y += c[j0 + l - r] * w[l];
+					}
+					x_[i - b] = Dt[i - b] * y;
+				}
+				v[i] -= x_[i - b];
+				if (premium) {
+					premium[i] = x_[i - b];
+				}
+			}
+		}, threads, 64);
+	}
+
+#ifdef _DEBUG
+	inline int value_test()
+	{
+		const curve::constant<> f(0.04);
+		const double σ = 0.01;
+
+		// 10 year 5% semiannual callable at par in 5 years
+		std::vector<double> u(20), c(20, 0.025);
+		for (size_t j = 0; j < 20; ++j) {
+			u[j] = 0.5 * (j + 1);
+		}
+		c.back() += 1;
+		const double v = value(20, u.data(), c.data(), f, σ, 5., 1.);
+		double bullet = 0;
+		for (size_t j = 0; j < 20; ++j) {
+			bullet += c[j] * f.discount(u[j]);
+		}
+		assert(v < bullet);
+		{
+			// single exercise on a fine Ho-Lee tree
+			const lattice::ho_lee<> t(f, σ, 10., 400);
+			const double tc[] = { 5 }, pc[] = { 1 };
+			const auto x = lattice::callable(t, 20, u.data(), c.data(), 1, tc, pc);
+			assert(math::fabs(x.value - v) < 1e-3);
+		}
+		{
+			// book of bonds with shared coupon dates and call dates
+			const size_t n = 300;
+			std::vector<size_t> o(n + 1, 0);
+			std::vector<double> ub, cb, tb(n), pb(n), vb(n), ob(n);
+			for (size_t i = 0; i < n; ++i) {
+				const size_t m = 2 * (1 + i % 30);
+				const double cpn = 0.01 * (1 + i % 7) / 2;
+				for (size_t j = 0; j < m; ++j) {
+					ub.push_back(0.5 * (j + 1));
+					cb.push_back(cpn + (j + 1 == m));
+				}
+				o[i + 1] = o[i] + m;
+				tb[i] = i % 11 == 0 ? 0 : 0.5 * (1 + i % 10); // some callable now
+				pb[i] = 1 + 0.01 * (i % 3);
+			}
+			value(n, o.data(), ub.data(), cb.data(), tb.data(), pb.data(), f, σ, vb.data(), ob.data(), 4);
+			for (size_t i = 0; i < n; ++i) {
+				const size_t m = o[i + 1] - o[i];
+				const double x = value(m, ub.data() + o[i], cb.data() + o[i], f, σ, tb[i], pb[i]);
+				assert(math::fabs(vb[i] - x) < 1e-12);
+				assert(ob[i] >= 0);
+			}
+			// σ = 0 is intrinsic
+			value(n, o.data(), ub.data(), cb.data(), tb.data(), pb.data(), f, 0., vb.data(), ob.data(), 2);
+			for (size_t i = 0; i < n; ++i) {
+				const size_t m = o[i + 1] - o[i];
+				assert(math::fabs(vb[i] - value(m, ub.data() + o[i], cb.data() + o[i], f, 0., tb[i], pb[i])) < 1e-12);
+			}
+			// nonpositive call prices are always exercised
+			for (size_t i = 0; i < n; ++i) {
+				pb[i] = -0.01 * (i % 3);
+			}
+			value(n, o.data(), ub.data(), cb.data(), tb.data(), pb.data(), f, σ, vb.data(), ob.data(), 3);
+			for (size_t i = 0; i < n; ++i) {
+				const size_t m = o[i + 1] - o[i];
+				const double x = value(m, ub.data() + o[i], cb.data() + o[i], f, σ, tb[i], pb[i]);
+				assert(math::fabs(vb[i] - x) < 1e-12);
+				double fwd = 0;
+				for (size_t j = o[i]; j < o[i + 1]; ++j) {
+					fwd += ub[j] > tb[i] ? cb[j] * f.discount(ub[j]) : 0;
+				}
+				assert(math::fabs(ob[i] - (fwd - pb[i] * f.discount(tb[i]))) < 1e-12);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::callable
@@ -0,0 +1,108 @@
+// tmx_cap.h - Caps and floors on a piecewise flat forward curve.
+// Caplet i covers [t[i], t[i + 1]] with accrual δ_i = t[i + 1] - t[i], fixes at t[i]
+// and pays δ_i max(L_i - k, 0) at t[i + 1] where the simple forward is
+//   L_i = (D(t[i])/D(t[i + 1]) - 1)/δ_i
+// Its value is δ_i D(t[i + 1]) call(L_i, σ_i sqrt(t[i]), k). All discounts come
+// from one walk over the curve knots and all Black terms from one batch call.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <cmath>
+#include <vector>
+#include "ensure.h"
+#include "tmx_curve_pwflat.h"
+#include "tmx_option.h"
+
+namespace tmx::cap {
+
+	// Forwards L[i] and annuities A[i] = δ_i D(t[i + 1]) of the n periods on dates t[0] < ... < t[n].
+	template<class T, class F>
+	inline void forwards(size_t n, const T* t, const curve::pwflat<T, F>& f, F* L, F* A)
+	{
+		std::vector<F> D(n + 1);
+		f.discount(n + 1, t, D.data());
+		for (size_t i = 0; i < n; ++i) {
+			const F δ = t[i + 1] - t[i];
+			L[i] = (D[i] / D[i + 1] - 1) / δ;
+			A[i] = δ * D[i + 1];
+		}
+	}
+
+	// Sum of caplets, or floorlets if floor, with strike k and Black vols σ[i]. Put each term in v if not null.
+	template<class T, class F>
+	inline F value(size_t n, const T* t, const curve::pwflat<T, F>& f, F k, const F* σ, F* v = nullptr, bool floor = false)
+	{
+		ensure(n == 0 || t[0] >= 0);
+
+		std::vector<F> L(n), A(n), s(n), k_(n, k), x(n);
+		forwards(n, t, f, L.data(), A.data());
+		for (size_t i = 0; i < n; ++i) {
+			s[i] = σ[i] * std::sqrt(t[i]);
+		}
+		if (floor) {
+			option::put::value(n, L.data(), s.data(), k_.data(), x.data());
+		}
+		else {
+			option::call::value(n, L.data(), s.data(), k_.data(), x.data());
+		}
+
+		F p = 0;
+		for (size_t i = 0; i < n; ++i) {
+			x[i] *= A[i];
+			p += x[i];
+		}
+		if (v) {
+			std::copy(x.begin(), x.end(), v);
+		}
+
+		return p;
+	}
+
+	// Floor with strike k.
+	template<class T, class F>
+	inline F floor(size_t n, const T* t, const curve::pwflat<T, F>& f, F k, const F* σ, F* v = nullptr)
+	{
+		return value(n, t, f, k, σ, v, true);
+	}
+
+#ifdef _DEBUG
+	inline int value_test()
+	{
+		const double tk[] = { 1, 2, 5, 10, 30 };
+		const double fk[] = { 0.03, 0.035, 0.04, 0.042, 0.045 };
+		const curve::pwflat<> f(5, tk, fk, 0.045);
+
+		// 30 year quarterly
+		const size_t n = 120;
+		std::vector<double> t(n + 1), σ(n), c(n), p(n);
+		for (size_t i = 0; i <= n; ++i) {
+			t[i] = 0.25 * i;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			σ[i] = 0.2 - 0.0005 * i;
+		}
+		const double k = 0.04;
+		const double C = value(n, t.data(), f, k, σ.data(), c.data());
+		const double P = floor(n, t.data(), f, k, σ.data(), p.data());
+
+		double C_ = 0, S = 0;
+		for (size_t i = 0; i < n; ++i) {
+			// scalar caplet
+			const double δ = t[i + 1] - t[i];
+			const double D0 = f.discount(t[i]), D1 = f.discount(t[i + 1]);
+			const double L = (D0 / D1 - 1) / δ;
+			const double x = δ * D1 * option::call::value(L, σ[i] * std::sqrt(t[i]), k);
+			assert(math::fabs(c[i] - x) < 1e-14);
+			C_ += x;
+			S += δ * D1 * (L - k);
+		}
+		assert(math::fabs(C - C_) < 1e-12);
+		// cap - floor = payer swap
+		assert(math::fabs(C - P - S) < 1e-12);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::cap
@@ -0,0 +1,292 @@
+// tmx_cash_flow_index.h - Portfolio cash flows sorted by payment date.
+// Flows from every instrument are kept in one array ordered by day serial
+// (days since 1970-01-01) so a date range is a contiguous slice and its total
+// is a difference of prefix sums.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <vector>
+#include "ensure.h"
+#include "tmx_date.h"
+#include "tmx_parallel.h"
+
+namespace tmx::cash_flow {
+
+	// Day serial of a calendar date.
+	constexpr int serial(const date::ymd& d)
+	{
+		return std::chrono::sys_days(d).time_since_epoch().count();
+	}
+#ifdef _DEBUG
+	static_assert(serial(date::to_ymd(1970, 1, 1)) == 0);
+	static_assert(serial(date::to_ymd(1970, 1, 2)) == 1);
+#endif // _DEBUG
+
+	// Stable parallel LSD radix sort of keys using 8 bit digits.
+	// Return permutation with key[perm[0]] <= key[perm[1]] <= ...
+	inline std::vector<uint32_t> radix_sort(size_t n, const uint32_t* key, unsigned p = parallel::concurrency())
+	{
+		constexpr unsigned R = 256;
+		std::vector<uint32_t> perm(n), tmp(n);
+		std::iota(perm.begin(), perm.end(), 0u);
+		if (n == 0) {
+			return perm;
+		}
+
+		const uint32_t max = *std::max_element(key, key + n);
+		const unsigned k = parallel::chunks(n, p, 1 << 14);
+		std::vector<size_t> count(size_t(k) * R);
+
+		for (unsigned shift = 0; shift < 32 && (max >> shift); shift += 8) {
+			std::fill(count.begin(), count.end(), 0);
+			parallel::for_chunks(n, [&](unsigned c, size_t b, size_t e) {
+				size_t* h = count.data() + size_t(c) * R;
+				for (size_t i = b; i < e; ++i) {
+					++h[(key[perm[i]] >> shift) & (R - 1)];
+				}
+			}, p, 1 << 14);
+			// Exclusive scan in (digit, chunk) order keeps the sort stable.
+			size_t s = 0;
+			for (unsigned d = 0; d < R; ++d) {
+				for (unsigned c = 0; c < k; ++c) {
+					size_t& h = count[size_t(c) * R + d];
+					const size_t h_ = h;
+					h = s;
+					s += h_;
+				}
+			}
+			parallel::for_chunks(n, [&](unsigned c, size_t b, size_t e) {
+				size_t* h = count.data() + size_t(c) * R;
+				for (size_t i = b; i < e; ++i) {
+					tmp[h[(key[perm[i]] >> shift) & (R - 1)]++] = perm[i];
+				}
+			}, p, 1 << 14);
+			perm.swap(tmp);
+		}
+
+		return perm;
+	}
+
+	// Time sorted index of cash flows with instrument ids.
+	template<class C = double>
+	class index {
+		std::vector<int> day;      // day serial of each flow
+		std::vector<unsigned> id;  // instrument id of each flow
+		std::vector<C> cash;       // amount of each flow
+		std::vector<C> sum;        // sum[k] = cash[0] + ... + cash[k - 1]
+		bool sorted = true;
+	public:
+		// Contiguous flows paying in a date range.
+		struct slice {
+			std::span<const int> day;
+			std::span<const unsigned> id;
+			std::span<const C> cash;
+
+			size_t size() const
+			{
+				return day.size();
+			}
+		};
+
+		index(size_t n = 0)
+			: sum(1, C(0))
+		{
+			day.reserve(n);
+			id.reserve(n);
+			cash.reserve(n);
+		}
+		index(const index&) = default;
+		index& operator=(const index&) = default;
+		index(index&&) = default;
+		index& operator=(index&&) = default;
+		~index() = default;
+
+		size_t size() const
+		{
+			return day.size();
+		}
+
+		// Add a cash flow. Call sort() before querying.
+		index& push_back(unsigned i, int d, C c)
+		{
+			day.push_back(d);
+			id.push_back(i);
+			cash.push_back(c);
+			sorted = false;
+
+			return *this;
+		}
+		index& push_back(unsigned i, const date::ymd& d, C c)
+		{
+			return push_back(i, serial(d), c);
+		}
+		// Add m cash flows of instrument i.
+		index& push_back(unsigned i, size_t m, const int* d, const C* c)
+		{
+			for (size_t j = 0; j < m; ++j) {
+				push_back(i, d[j], c[j]);
+			}
+
+			return *this;
+		}
+
+		// Sort flows by day using p threads and compute prefix sums.
+		index& sort(unsigned p = parallel::concurrency())
+		{
+			const size_t n = day.size();
+
+			if (n > 0) {
+				const int d0 = *std::min_element(day.begin(), day.end());
+				std::vector<uint32_t> key(n);
+				parallel::for_each(n, [&](size_t i) { key[i] = static_cast<uint32_t>(day[i] - d0); }, p, 1 << 14);
+				const auto perm = radix_sort(n, key.data(), p);
+
+				std::vector<int> day_(n);
+				std::vector<unsigned> id_(n);
+				std::vector<C> cash_(n);
+				parallel::for_each(n, [&](size_t i) {
+					day_[i] = day[perm[i]];
+					id_[i] = id[perm[i]];
+					cash_[i] = cash[perm[i]];
+				}, p, 1 << 14);
+				day.swap(day_);
+				id.swap(id_);
+				cash.swap(cash_);
+			}
+
+			sum.resize(n + 1);
+			sum[0] = 0;
+			std::partial_sum(cash.begin(), cash.end(), sum.begin() + 1);
+			sorted = true;
+
+			return *this;
+		}
+
+		// Flows paying on days d0 <= d < d1.
+		slice range(int d0, int d1) const
+		{
+			const auto [b, e] = bounds(d0, d1);
+
+			return slice{
+				std::span<const int>(day.data() + b, e - b),
+				std::span<const unsigned>(id.data() + b, e - b),
+				std::span<const C>(cash.data() + b, e - b)
+			};
+		}
+		slice range(const date::ymd& d0, const date::ymd& d1) const
+		{
+			return range(serial(d0), serial(d1));
+		}
+
+		// Total cash paying on days d0 <= d < d1.
+		C total(int d0, int d1) const
+		{
+			const auto [b, e] = bounds(d0, d1);
+
+			return sum[e] - sum[b];
+		}
+		C total(const date::ymd& d0, const date::ymd& d1) const
+		{
+			return total(serial(d0), serial(d1));
+		}
+
+		// Cash ladder s[i] = total(d[i], d[i + 1]) for increasing d[0], ..., d[n - 1].
+		void ladder(size_t n, const int* d, C* s) const
+		{
+			ensure(sorted);
+
+			if (n == 0) {
+				return;
+			}
+			size_t b = std::lower_bound(day.begin(), day.end(), d[0]) - day.begin();
+			for (size_t i = 0; i + 1 < n; ++i) {
+				const size_t e = std::lower_bound(day.begin() + b, day.end(), d[i + 1]) - day.begin();
+				s[i] = sum[e] - sum[b];
+				b = e;
+			}
+		}
+
+	private:
+		std::pair<size_t, size_t> bounds(int d0, int d1) const
+		{
+			ensure(sorted);
+
+			if (d1 <= d0) {
+				return { 0, 0 };
+			}
+			const size_t b = std::lower_bound(day.begin(), day.end(), d0) - day.begin();
+			const size_t e = std::lower_bound(day.begin() + b, day.end(), d1) - day.begin();
+
+			return { b, e };
+		}
+
+#ifdef _DEBUG
+	public:
+		static int test()
+		{
+			{
+				index<C> i;
+				assert(0 == i.size());
+				assert(0 == i.total(0, 100));
+				assert(0 == i.range(0, 100).size());
+			}
+			{
+				using date::to_ymd;
+				index<C> i;
+				i.push_back(1, to_ymd(2024, 6, 30), C(2));
+				i.push_back(0, to_ymd(2024, 1, 15), C(1));
+				i.push_back(1, to_ymd(2024, 12, 31), C(4));
+				i.push_back(2, to_ymd(2024, 6, 30), C(8));
+				i.sort(2);
+				assert(4 == i.size());
+
+				auto s = i.range(to_ymd(2024, 6, 30), to_ymd(2024, 7, 1));
+				assert(2 == s.size());
+				// stable on equal days
+				assert(s.id[0] == 1 && s.id[1] == 2);
+				assert(s.cash[0] == 2 && s.cash[1] == 8);
+				assert(10 == i.total(to_ymd(2024, 6, 30), to_ymd(2024, 7, 1)));
+				assert(15 == i.total(to_ymd(2024, 1, 1), to_ymd(2025, 1, 1)));
+				assert(0 == i.total(to_ymd(2025, 1, 1), to_ymd(2024, 1, 1)));
+
+				int d[] = { serial(to_ymd(2024, 1, 1)), serial(to_ymd(2024, 4, 1)), serial(to_ymd(2024, 7, 1)), serial(to_ymd(2025, 1, 1)) };
+				C l[3];
+				i.ladder(4, d, l);
+				assert(l[0] == 1 && l[1] == 10 && l[2] == 4);
+			}
+			{
+				// compare against std::stable_sort
+				const size_t n = 100'000;
+				index<C> i(n);
+				std::vector<std::pair<int, unsigned>> v(n);
+				uint32_t x = 1;
+				for (size_t k = 0; k < n; ++k) {
+					x = 1664525 * x + 1013904223; // LCG
+					const int d = -5000 + static_cast<int>(x % 40'000);
+					v[k] = { d, static_cast<unsigned>(k) };
+					i.push_back(static_cast<unsigned>(k), d, C(1));
+				}
+				i.sort(4);
+				std::stable_sort(v.begin(), v.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+				const auto s = i.range(-10'000, 50'000);
+				assert(n == s.size());
+				for (size_t k = 0; k < n; ++k) {
+					assert(s.day[k] == v[k].first);
+					assert(s.id[k] == v[k].second);
+				}
+				const auto t = std::count_if(v.begin(), v.end(), [](const auto& a) { return 0 <= a.first && a.first < 10'000; });
+				assert(C(t) == i.total(0, 10'000));
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+} // namespace tmx::cash_flow
@@ -2,6 +2,7 @@
 #pragma once
 #include <cmath>
 #include <utility>
+#include "tmx_math.h"
 
 namespace tmx::curve {
 
@@ -117,13 +118,14 @@ namespace tmx::curve {
 	template<class T = double, class F = double>
 	class plus : public base<T,F> {
 		const base<T, F>& f;
-		const base<T, F>& g;
+		const base<T, F>* g; // nullptr if constant spread
+		F s; // constant spread
 	public:
 		plus(const base<T, F>& f, const base<T, F>& g)
-			: f(f), g(g)
+			: f(f), g(&g), s(0)
 		{ }
 		plus(const base<T, F>& f, F s)
-			: f(f), g(constant(s))
+			: f(f), g(nullptr), s(s)
 		{ }
 		plus(const plus& p) = default;
 		plus& operator=(const plus& p) = default;
@@ -131,11 +133,11 @@ namespace tmx::curve {
 
 		F _value(T u) const override
 		{
-			return f.value(u) + g.value(u);
+			return f.value(u) + (g ? g->value(u) : s);
 		}
-		F _integral(T u, [[maybe_unused]] T t) const override
+		F _integral(T u, T t) const override
 		{
-			return f.integral(u) + g.integral(u);
+			return f.integral(u, t) + (g ? g->integral(u, t) : s * (u - t));
 		}
 		plus& _extrapolate([[maybe_unused]] F _f) override
 		{
@@ -146,13 +148,13 @@ namespace tmx::curve {
 		}	
 		F _extrapolate() const override
 		{
-			return f.extrapolate() + g.extrapolate();
+			return f.extrapolate() + (g ? g->extrapolate() : s);
 		}
 		// Smallest last point on both curves.
 		std::pair<T, F> _back() const override
 		{
 			const auto fb = f.back();
-			const auto gb = g.back();
+			const auto gb = g ? g->back() : std::pair<T, F>(math::infinity<T>, s);
 
 			return { std::min(fb.first, gb.first), fb.second + gb.second };
 		}
@@ -0,0 +1,112 @@
+// tmx_curve_handle.h - Versioned handle to a published curve.
+// Readers take a snapshot holding the curve and its version. Every publish
+// installs a new immutable curve with a version from a global counter, so
+// versions are unique across handles and increase over time.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "ensure.h"
+#include "tmx_curve.h"
+
+namespace tmx::curve {
+
+	// Next curve version. Version 0 means nothing published.
+	inline uint64_t next_version()
+	{
+		static std::atomic<uint64_t> v = 0;
+
+		return ++v;
+	}
+
+	template<class T = double, class F = double>
+	class handle {
+	public:
+		// Published curve and its version.
+		struct snapshot {
+			std::shared_ptr<const base<T, F>> curve;
+			uint64_t version = 0;
+
+			explicit operator bool() const
+			{
+				return curve != nullptr;
+			}
+			const base<T, F>& operator*() const
+			{
+				return *curve;
+			}
+		};
+	private:
+		std::atomic<std::shared_ptr<const snapshot>> s;
+	public:
+		handle()
+			: s(std::make_shared<const snapshot>())
+		{ }
+		handle(std::shared_ptr<const base<T, F>> f)
+			: handle()
+		{
+			publish(std::move(f));
+		}
+		handle(const handle&) = delete;
+		handle& operator=(const handle&) = delete;
+		~handle() = default;
+
+		// Install a new curve and return its version.
+		uint64_t publish(std::shared_ptr<const base<T, F>> f)
+		{
+			ensure(f);
+
+			const uint64_t v = next_version();
+			s.store(std::make_shared<const snapshot>(snapshot{ std::move(f), v }));
+
+			return v;
+		}
+		// Construct a curve in place and publish it.
+		template<class Curve, class... Args>
+		uint64_t emplace(Args&&... args)
+		{
+			return publish(std::make_shared<const Curve>(std::forward<Args>(args)...));
+		}
+
+		// Current curve and version.
+		snapshot get() const
+		{
+			return *s.load();
+		}
+		uint64_t version() const
+		{
+			return s.load()->version;
+		}
+
+#ifdef _DEBUG
+		static int test()
+		{
+			{
+				handle<T, F> h;
+				assert(0 == h.version());
+				assert(!h.get());
+
+				const uint64_t v1 = h.emplace<constant<T, F>>(F(0.01));
+				assert(v1 == h.version());
+				auto s1 = h.get();
+				assert(s1 && (*s1).value(0) == F(0.01));
+
+				const uint64_t v2 = h.emplace<constant<T, F>>(F(0.02));
+				assert(v2 > v1);
+				// old snapshot still valid
+				assert((*s1).value(0) == F(0.01));
+				assert((*h.get()).value(0) == F(0.02));
+
+				handle<T, F> h2(std::make_shared<const constant<T, F>>(F(0.03)));
+				assert(h2.version() > v2);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+} // namespace tmx::curve
@@ -50,6 +50,22 @@ namespace tmx::curve {
 			return { t.back(), f.back() };
 		}
 
+		// Batch I[j] = integral(u[j], 0) for increasing u[j] in one walk.
+		void integral(size_t m, const T* u, F* I) const
+		{
+			tmx::pwflat::integral(m, u, t.size(), t.data(), f.data(), _f, I);
+		}
+		// Batch D[j] = discount(u[j]) for increasing u[j].
+		void discount(size_t m, const T* u, F* D) const
+		{
+			integral(m, u, D);
+			for (size_t j = 0; j < m; ++j) {
+				D[j] = std::exp(-D[j]);
+			}
+		}
+		using base<T, F>::integral;
+		using base<T, F>::discount;
+
 
 
 
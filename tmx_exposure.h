@@ -0,0 +1,201 @@
+// tmx_exposure.h - Exposure profiles under Ho-Lee without nested simulation.
+// The state at t is B_t and the conditional discounts are closed form
+//   D_t(u) = exp(E[log D_t(u)] - σ (u - t) B_t)
+// so a netting set with flows C(u) is worth V_t = sum_{u > t} C(u) A_t(u) exp(-σ (u - t) B_t)
+// where A_t(u) = exp(ELogD(D(t), D(u), t, u, σ)). Flows of all instruments in a
+// netting set are merged by date once, A_t(u) is computed once per date, and
+// paths only evaluate the exponentials. Paths are simulated in fixed blocks
+// with their own streams so results do not depend on the number of threads.
+// Memory does not grow with the number of paths: blocks run in waves of a
+// fixed size and each wave is folded, in path order, into running sums for
+// EE and P-square quantile estimates for PFE.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+#include "ensure.h"
+#include "tmx_ho_lee.h"
+#include "tmx_parallel.h"
+#include "tmx_scenario.h"
+#include "tmx_variate_normal.h"
+
+namespace tmx::exposure {
+
+	struct options {
+		size_t paths = 10'000;
+		double q = 0.95;     // PFE quantile
+		uint64_t seed = 0;
+		size_t block = 64;   // paths per stream
+		size_t wave = 64;    // blocks held in memory at once
+		unsigned threads = parallel::concurrency();
+	};
+
+	// Expected and potential future exposure of each netting set at each date.
+	template<class T = double, class F = double>
+	struct profile {
+		std::vector<T> t;
+		size_t sets = 0;
+		std::vector<F> ee, pfe; // sets x dates
+
+		F EE(size_t s, size_t k) const
+		{
+			return ee[s * t.size() + k];
+		}
+		F PFE(size_t s, size_t k) const
+		{
+			return pfe[s * t.size() + k];
+		}
+	};
+
+	// Instrument i has flows u[o[i]..o[i + 1]), c[o[i]..o[i + 1]) and belongs to netting set g[i] < S.
+	// Exposure dates t[0] < ... < t[K - 1] are positive.
+	template<class U, class C, class T, class F>
+	inline profile<T, F> run(size_t n, const size_t* o, const U* u, const C* c, const unsigned* g, size_t S,
+		const curve::base<T, F>& f, F σ, size_t K, const T* t, const options& opt = options{})
+	{
+		ensure(K == 0 || t[0] > 0);
+
+		// merge flows by date per netting set
+		std::vector<std::vector<T>> us(S);
+		std::vector<std::vector<F>> cs(S);
+		{
+			std::vector<std::map<T, F>> m(S);
+			for (size_t i = 0; i < n; ++i) {
+				ensure(g[i] < S);
+				for (size_t j = o[i]; j < o[i + 1]; ++j) {
+					m[g[i]][u[j]] += c[j];
+				}
+			}
+			for (size_t s = 0; s < S; ++s) {
+				for (const auto& [uj, cj] : m[s]) {
+					us[s].push_back(uj);
+					cs[s].push_back(cj);
+				}
+			}
+		}
+
+		// per set and date: C(u) A_t(u) and σ (u - t) of live flows
+		std::vector<std::vector<std::vector<F>>> a(S, std::vector<std::vector<F>>(K)), β(a);
+		for (size_t s = 0; s < S; ++s) {
+			const auto& u_ = us[s];
+			std::vector<F> Du(u_.size());
+			for (size_t j = 0; j < u_.size(); ++j) {
+				Du[j] = f.discount(u_[j]);
+			}
+			for (size_t k = 0; k < K; ++k) {
+				const F Dt = f.discount(t[k]);
+				const size_t j0 = std::upper_bound(u_.begin(), u_.end(), t[k]) - u_.begin();
+				for (size_t j = j0; j < u_.size(); ++j) {
+					a[s][k].push_back(cs[s][j] * std::exp(ho_lee::ELogD(Dt, Du[j], t[k], u_[j], σ)));
+					β[s][k].push_back(σ * (u_[j] - t[k]));
+				}
+			}
+		}
+
+		// exposures V+ by set, date and path of one wave
+		const size_t P = opt.paths;
+		const size_t block = std::max<size_t>(opt.block, 1);
+		const size_t wave = std::max<size_t>(opt.wave, 1) * block;
+		std::vector<F> E(S * K * std::min(P, wave));
+		std::vector<F> sum(S * K, F(0));
+		std::vector<scenario::p2> q(S * K, scenario::p2(opt.q));
+		for (size_t w0 = 0; w0 < P; w0 += wave) {
+			const size_t W = std::min(P, w0 + wave) - w0;
+			const size_t b0 = w0 / block;
+			parallel::for_each((W + block - 1) / block, [&](size_t b_) {
+				const size_t b = b0 + b_;
+				variate::stream r(opt.seed, b);
+				const size_t p0 = b * block - w0, p1 = std::min(P, (b + 1) * block) - w0;
+				std::vector<F> B(p1 - p0, F(0)), z(p1 - p0);
+				T t_ = 0;
+				for (size_t k = 0; k < K; ++k) {
+					variate::normal<F>::ziggurat(z.size(), z.data(), r);
+					const F dt = std::sqrt(F(t[k] - t_));
+					for (size_t p = 0; p < B.size(); ++p) {
+						B[p] += dt * z[p];
+					}
+					t_ = t[k];
+					for (size_t s = 0; s < S; ++s) {
+						const auto& ak = a[s][k];
+						const auto& βk = β[s][k];
+						F* e = E.data() + (s * K + k) * W + p0;
+						for (size_t p = 0; p < B.size(); ++p) {
+							F v = 0;
+							for (size_t j = 0; j < ak.size(); ++j) {
+								v += ak[j] * std::exp(-βk[j] * B[p]);
+							}
+							e[p] = std::max(v, F(0));
+						}
+					}
+				}
+			}, opt.threads);
+			// fold in path order
+			parallel::for_each(S * K, [&](size_t sk) {
+				const F* e = E.data() + sk * W;
+				for (size_t p = 0; p < W; ++p) {
+					sum[sk] += e[p];
+					q[sk].add(static_cast<double>(e[p]));
+				}
+			}, opt.threads);
+		}
+
+		profile<T, F> x;
+		x.t.assign(t, t + K);
+		x.sets = S;
+		x.ee.resize(S * K);
+		x.pfe.resize(S * K);
+		for (size_t sk = 0; sk < S * K; ++sk) {
+			x.ee[sk] = P ? sum[sk] / P : F(0);
+			x.pfe[sk] = P ? static_cast<F>(q[sk].value()) : F(0);
+		}
+
+		return x;
+	}
+
+#ifdef _DEBUG
+	inline int run_test()
+	{
+		const curve::constant<> f(0.04);
+		const double σ = 0.01;
+
+		// 0: zero coupon bond paying 1 at 10
+		// 1, 2: receive and pay the same 5 year bond in one netting set
+		const size_t o[] = { 0, 1, 6, 11 };
+		const double u[] = { 10, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5 };
+		const double c[] = { 1, 0.05, 0.05, 0.05, 0.05, 1.05, -0.05, -0.05, -0.05, -0.05, -1.05 };
+		const unsigned g[] = { 0, 1, 1 };
+		const double t[] = { 0.5, 1, 2, 4, 8 };
+
+		options opt;
+		opt.paths = 20'000;
+		opt.seed = 7;
+		opt.threads = 4;
+		const auto x = run(3, o, u, c, g, 2, f, σ, 5, t, opt);
+		for (size_t k = 0; k < 5; ++k) {
+			// E[D_t(u)] and the q quantile of lognormal D_t(u)
+			const double tk = t[k], m = ho_lee::ELogD(f.discount(tk), f.discount(10.), tk, 10., σ);
+			const double s = σ * (10 - tk) * std::sqrt(tk);
+			assert(math::fabs(x.EE(0, k) / std::exp(m + s * s / 2) - 1) < 3 * s / std::sqrt(opt.paths) + 1e-4);
+			const double z = variate::normal<>{}.inv(opt.q);
+			assert(math::fabs(x.PFE(0, k) / std::exp(m + s * z) - 1) < 0.05 * s + 1e-4);
+			// offsetting trades have no exposure
+			assert(math::fabs(x.EE(1, k)) < 1e-15);
+		}
+
+		// independent of the number of threads and of the paths held in memory
+		opt.threads = 1;
+		const auto y = run(3, o, u, c, g, 2, f, σ, 5, t, opt);
+		assert(x.ee == y.ee && x.pfe == y.pfe);
+		opt.wave = 3;
+		const auto z = run(3, o, u, c, g, 2, f, σ, 5, t, opt);
+		assert(x.ee == z.ee && x.pfe == z.pfe);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::exposure
@@ -0,0 +1,523 @@
+// tmx_feed.h - Quote feed ingestion.
+// A source (capture file or local socket) is replayed by one producer into a
+// bounded lock-free ring. Consumers drain the ring, keep only the latest
+// quote per instrument, and hand each coalesced batch to a sink such as
+// feed::yields, which updates the per-bond analytics caches.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <filesystem>
+#endif // _DEBUG
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "ensure.h"
+#include "tmx_analytics.h"
+
+namespace tmx::feed {
+
+	// Quote message as stored in capture files and sent over sockets.
+	struct quote {
+		int64_t time;  // nanoseconds
+		uint32_t id;   // dense instrument index, see registry::index
+		uint32_t flags;
+		double price;
+	};
+	static_assert(sizeof(quote) == 24);
+
+	// Bounded single producer multiple consumer lock-free ring.
+	template<class X>
+	class ring {
+		struct cell {
+			std::atomic<uint64_t> seq;
+			X x;
+		};
+		std::unique_ptr<cell[]> c;
+		uint64_t mask;
+		alignas(64) std::atomic<uint64_t> head = 0; // next push
+		alignas(64) std::atomic<uint64_t> tail = 0; // next pop
+	public:
+		// Ring with at least n cells.
+		ring(size_t n = 1 << 16)
+		{
+			uint64_t m = 2;
+			while (m < n) {
+				m <<= 1;
+			}
+			c = std::make_unique<cell[]>(m);
+			for (uint64_t i = 0; i < m; ++i) {
+				c[i].seq.store(i, std::memory_order_relaxed);
+			}
+			mask = m - 1;
+		}
+		ring(const ring&) = delete;
+		ring& operator=(const ring&) = delete;
+		~ring() = default;
+
+		size_t capacity() const
+		{
+			return mask + 1;
+		}
+		bool empty() const
+		{
+			return tail.load(std::memory_order_acquire) >= head.load(std::memory_order_acquire);
+		}
+
+		// Producer only. Return false if full.
+		bool push(const X& x)
+		{
+			const uint64_t h = head.load(std::memory_order_relaxed);
+			cell& e = c[h & mask];
+			if (e.seq.load(std::memory_order_acquire) != h) {
+				return false;
+			}
+			e.x = x;
+			e.seq.store(h + 1, std::memory_order_release);
+			head.store(h + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		// Any consumer. Return false if empty.
+		bool pop(X& x)
+		{
+			uint64_t t = tail.load(std::memory_order_relaxed);
+			while (true) {
+				cell& e = c[t & mask];
+				const uint64_t s = e.seq.load(std::memory_order_acquire);
+				const int64_t d = static_cast<int64_t>(s - (t + 1));
+				if (d == 0) {
+					if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+						x = e.x;
+						e.seq.store(t + mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (d < 0) {
+					return false;
+				}
+				else {
+					t = tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+	};
+
+	// Keep the latest quote per instrument.
+	class coalesce {
+		std::vector<int64_t> slot; // position in batch or -1
+		std::vector<quote> batch;
+	public:
+		coalesce(size_t n = 0)
+			: slot(n, -1)
+		{ }
+
+		size_t size() const
+		{
+			return batch.size();
+		}
+
+		void add(const quote& q)
+		{
+			if (q.id >= slot.size()) {
+				slot.resize(q.id + 1, -1);
+			}
+			int64_t& s = slot[q.id];
+			if (s < 0) {
+				s = static_cast<int64_t>(batch.size());
+				batch.push_back(q);
+			}
+			else if (batch[s].time <= q.time) {
+				batch[s] = q;
+			}
+		}
+		// Hand batch to f and reset.
+		template<class F>
+		void flush(const F& f)
+		{
+			if (batch.empty()) {
+				return;
+			}
+			f(std::span<const quote>(batch.data(), batch.size()));
+			for (const quote& q : batch) {
+				slot[q.id] = -1;
+			}
+			batch.clear();
+		}
+	};
+
+	// Capture file of raw quote records.
+	class capture {
+		std::ifstream s;
+	public:
+		capture(const std::string& path)
+			: s(path, std::ios::binary)
+		{
+			ensure_message(s.good(), "feed::capture: cannot open " + path);
+		}
+
+		bool next(quote& q)
+		{
+			return static_cast<bool>(s.read(reinterpret_cast<char*>(&q), sizeof(quote)));
+		}
+
+		static void write(const std::string& path, size_t n, const quote* q)
+		{
+			std::ofstream o(path, std::ios::binary);
+			ensure_message(o.good(), "feed::capture: cannot create " + path);
+			o.write(reinterpret_cast<const char*>(q), n * sizeof(quote));
+		}
+	};
+
+#ifndef _WIN32
+	// Quote records read from a file descriptor, e.g. a connected local socket.
+	class descriptor {
+	protected:
+		int fd;
+	public:
+		descriptor(int fd)
+			: fd(fd)
+		{ }
+
+		bool next(quote& q)
+		{
+			char* p = reinterpret_cast<char*>(&q);
+			size_t n = 0;
+			while (n < sizeof(quote)) {
+				const ssize_t r = ::read(fd, p + n, sizeof(quote) - n);
+				if (r <= 0) {
+					return false;
+				}
+				n += static_cast<size_t>(r);
+			}
+
+			return true;
+		}
+	};
+
+	// Connected local stream socket, closed on destruction.
+	class socket : public descriptor {
+	public:
+		// Connect to the listener at path.
+		socket(const std::string& path)
+			: descriptor(-1)
+		{
+			const sockaddr_un a = address(path);
+			fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			ensure_message(fd >= 0, "feed::socket: socket failed");
+			if (::connect(fd, reinterpret_cast<const sockaddr*>(&a), sizeof(a)) != 0) {
+				::close(fd);
+				ensure_message(false, "feed::socket: cannot connect to " + path);
+			}
+		}
+		// Take ownership of a connected descriptor, e.g. one end of a socketpair.
+		explicit socket(int fd)
+			: descriptor(fd)
+		{
+			ensure(fd >= 0);
+		}
+		socket(const socket&) = delete;
+		socket& operator=(const socket&) = delete;
+		~socket()
+		{
+			::close(fd);
+		}
+
+		// Send n quotes. Return false if the peer has gone away.
+		bool write(size_t n, const quote* q)
+		{
+			const char* p = reinterpret_cast<const char*>(q);
+			size_t k = 0;
+			while (k < n * sizeof(quote)) {
+				const ssize_t r = ::send(fd, p + k, n * sizeof(quote) - k, MSG_NOSIGNAL);
+				if (r <= 0) {
+					return false;
+				}
+				k += static_cast<size_t>(r);
+			}
+
+			return true;
+		}
+		// No more quotes from this end, the peer reads end of stream.
+		void shutdown()
+		{
+			::shutdown(fd, SHUT_WR);
+		}
+
+		static sockaddr_un address(const std::string& path)
+		{
+			sockaddr_un a{};
+			ensure_message(path.size() < sizeof(a.sun_path), "feed::socket: path too long " + path);
+			a.sun_family = AF_UNIX;
+			std::memcpy(a.sun_path, path.c_str(), path.size() + 1);
+
+			return a;
+		}
+	};
+
+	// Local socket listening at path, unlinked on destruction.
+	class listener {
+		std::string path;
+		int fd;
+	public:
+		listener(const std::string& path, int backlog = 1)
+			: path(path), fd(-1)
+		{
+			const sockaddr_un a = socket::address(path);
+			fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			ensure_message(fd >= 0, "feed::listener: socket failed");
+			if (::bind(fd, reinterpret_cast<const sockaddr*>(&a), sizeof(a)) != 0 || ::listen(fd, backlog) != 0) {
+				::close(fd);
+				ensure_message(false, "feed::listener: cannot listen on " + path);
+			}
+		}
+		listener(const listener&) = delete;
+		listener& operator=(const listener&) = delete;
+		~listener()
+		{
+			::close(fd);
+			::unlink(path.c_str());
+		}
+
+		// Wait for the next connection.
+		std::unique_ptr<socket> accept()
+		{
+			const int c = ::accept(fd, nullptr, nullptr);
+			ensure_message(c >= 0, "feed::listener: accept failed on " + path);
+
+			return std::make_unique<socket>(c);
+		}
+	};
+#endif // _WIN32
+
+	// Push every quote of source into r. Pace by quote time divided by speed, or as fast as possible if speed <= 0.
+	template<class Source>
+	inline size_t replay(Source& source, ring<quote>& r, double speed = 0)
+	{
+		using clock = std::chrono::steady_clock;
+		const auto start = clock::now();
+		int64_t t0 = 0;
+		size_t n = 0;
+
+		quote q;
+		while (source.next(q)) {
+			if (n == 0) {
+				t0 = q.time;
+			}
+			if (speed > 0) {
+				const auto due = start + std::chrono::nanoseconds(static_cast<int64_t>((q.time - t0) / speed));
+				std::this_thread::sleep_until(due);
+			}
+			while (!r.push(q)) {
+				std::this_thread::yield();
+			}
+			++n;
+		}
+
+		return n;
+	}
+
+	// Ring, consumers and sink. The sink is called concurrently from consumer threads.
+	class handler {
+		using sink = std::function<void(std::span<const quote>)>;
+		ring<quote> r;
+		sink f;
+		unsigned consumers;
+		size_t batch;
+	public:
+		handler(sink f, unsigned consumers = 1, size_t batch = 256, size_t capacity = 1 << 16)
+			: r(capacity), f(std::move(f)), consumers(std::max(consumers, 1u)), batch(batch)
+		{ }
+
+		// Replay source through the ring. Return number of quotes read.
+		template<class Source>
+		size_t run(Source& source, double speed = 0)
+		{
+			std::atomic<bool> done = false;
+			std::vector<std::thread> ts;
+			for (unsigned i = 0; i < consumers; ++i) {
+				ts.emplace_back([this, &done] {
+					coalesce c;
+					quote q;
+					while (true) {
+						if (r.pop(q)) {
+							c.add(q);
+							if (c.size() >= batch) {
+								c.flush(f);
+							}
+							continue;
+						}
+						c.flush(f); // ring drained
+						if (done.load(std::memory_order_acquire) && r.empty()) {
+							break;
+						}
+						std::this_thread::yield();
+					}
+					c.flush(f);
+				});
+			}
+
+			const size_t n = replay(source, r, speed);
+			done.store(true, std::memory_order_release);
+			for (auto& t : ts) {
+				t.join();
+			}
+
+			return n;
+		}
+	};
+
+	// Sink solving yields of per-bond analytics caches indexed by quote id.
+	// Quotes older than the last applied quote of an instrument are dropped.
+	template<class U = double, class C = double>
+	class yields {
+		std::vector<analytics::cache<U, C>>& b;
+		std::unique_ptr<std::atomic_flag[]> lock;
+		std::vector<int64_t> last;
+	public:
+		yields(std::vector<analytics::cache<U, C>>& b)
+			: b(b), lock(std::make_unique<std::atomic_flag[]>(b.size())), last(b.size(), INT64_MIN)
+		{ }
+
+		void operator()(std::span<const quote> qs)
+		{
+			for (const quote& q : qs) {
+				if (q.id >= b.size()) {
+					continue;
+				}
+				while (lock[q.id].test_and_set(std::memory_order_acquire)) {
+					std::this_thread::yield();
+				}
+				if (q.time >= last[q.id]) {
+					last[q.id] = q.time;
+					b[q.id].yield(C(q.price));
+				}
+				lock[q.id].clear(std::memory_order_release);
+			}
+		}
+	};
+
+#ifdef _DEBUG
+	inline int feed_test()
+	{
+		{
+			ring<int> r(3);
+			assert(4 == r.capacity());
+			int x;
+			assert(r.empty() && !r.pop(x));
+			for (int i = 0; i < 4; ++i) {
+				assert(r.push(i));
+			}
+			assert(!r.push(4));
+			assert(r.pop(x) && 0 == x);
+			assert(r.push(4));
+			for (int i = 1; i <= 4; ++i) {
+				assert(r.pop(x) && i == x);
+			}
+			assert(r.empty());
+		}
+		{
+			coalesce c;
+			c.add(quote{ 1, 7, 0, 99 });
+			c.add(quote{ 2, 3, 0, 98 });
+			c.add(quote{ 3, 7, 0, 100 });
+			c.add(quote{ 0, 7, 0, 50 }); // stale
+			assert(2 == c.size());
+			c.flush([](std::span<const quote> qs) {
+				assert(2 == qs.size());
+				assert(7 == qs[0].id && 100 == qs[0].price);
+				assert(3 == qs[1].id && 98 == qs[1].price);
+			});
+			assert(0 == c.size());
+		}
+		{
+			// capture -> ring -> coalesce -> yields
+			const double u[] = { 1, 2, 3 };
+			const double c[] = { 0.05, 0.05, 1.05 };
+			const auto price = [&](double y) {
+				return c[0] * std::exp(-y * u[0]) + c[1] * std::exp(-y * u[1]) + c[2] * std::exp(-y * u[2]);
+			};
+			const uint32_t n = 50;
+			std::vector<analytics::cache<>> b(n, analytics::cache<>(3, u, c, 0.04));
+			std::vector<quote> qs;
+			for (int64_t k = 0; k < 2000; ++k) {
+				const uint32_t id = static_cast<uint32_t>(k % n);
+				qs.push_back(quote{ k, id, 0, price(0.04 + 0.0001 * (k / n) + 0.00001 * id) });
+			}
+			const std::string path = (std::filesystem::temp_directory_path() / "tmx_feed_test.bin").string();
+			capture::write(path, qs.size(), qs.data());
+			{
+				capture s(path);
+				yields sink(b);
+				handler h(std::ref(sink), 3, 16, 64);
+				assert(qs.size() == h.run(s));
+			}
+			std::filesystem::remove(path);
+			for (uint32_t id = 0; id < n; ++id) {
+				// last tick of each instrument
+				assert(math::fabs(b[id].yield() - (0.04 + 0.0001 * 39 + 0.00001 * id)) <= 1e-8);
+			}
+#ifndef _WIN32
+			// socketpair -> ring -> coalesce -> yields
+			{
+				int sv[2];
+				const int rc = ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+				assert(0 == rc);
+				socket in(sv[0]);
+				std::vector<analytics::cache<>> b_(n, analytics::cache<>(3, u, c, 0.04));
+				std::thread t([&qs, fd = sv[1]] {
+					socket out(fd);
+					for (size_t i = 0; i < qs.size(); i += 100) {
+						const bool ok = out.write(std::min<size_t>(100, qs.size() - i), qs.data() + i);
+						assert(ok);
+					}
+				}); // closing out ends the stream
+				yields sink(b_);
+				handler h(std::ref(sink), 2, 16, 64);
+				assert(qs.size() == h.run(in));
+				t.join();
+				for (uint32_t id = 0; id < n; ++id) {
+					assert(b_[id].yield() == b[id].yield());
+				}
+			}
+			// listener at a path
+			{
+				const std::string path = (std::filesystem::temp_directory_path() / ("tmx_feed_test_" + std::to_string(::getpid()))).string();
+				listener l(path);
+				std::thread t([&qs, &path] {
+					socket out(path);
+					const bool ok = out.write(qs.size(), qs.data());
+					assert(ok);
+					out.shutdown();
+				});
+				const auto in = l.accept();
+				quote q;
+				size_t k = 0;
+				while (in->next(q)) {
+					assert(q.time == qs[k].time && q.id == qs[k].id && q.price == qs[k].price);
+					++k;
+				}
+				t.join();
+				assert(qs.size() == k);
+			}
+#endif // _WIN32
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::feed
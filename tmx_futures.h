@@ -0,0 +1,280 @@
+// tmx_futures.h - Treasury futures basket analytics.
+// A deliverable bond with annual coupon c pays c/2 semiannually back from its
+// maturity and has clean price P. The conversion factor is the clean price per
+// unit face at a 6% semiannual yield with the time from first delivery to
+// maturity rounded down to whole quarters. For futures price F, delivery at T
+// and term repo rate r (simple)
+//   gross basis = P - F cf
+//   carry       = a(T) - a(0) + sum c_u (1 + r (T - u)) - (P + a(0)) r T
+//   net basis   = gross basis - carry
+//   implied repo = (F cf + a(T) + sum c_u - P - a(0)) / ((P + a(0)) T - sum c_u (T - u))
+// where a(t) is accrued interest and c_u are coupons paid at u in (0, T]. Both
+// carry and implied repo reinvest intermediate coupons at the repo rate, so the
+// net basis is zero exactly when the implied repo equals r. The cheapest to
+// deliver has the highest implied repo. Coupon schedules are built once per
+// bond, priced with value::present and shared by every contract. Contracts run
+// in parallel and each is a loop over the basket.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include "tmx_curve_pwflat.h"
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "ensure.h"
+#include "tmx_math.h"
+#include "tmx_curve.h"
+#include "tmx_parallel.h"
+#include "tmx_value.h"
+
+namespace tmx::futures {
+
+	// Conversion factor of coupon c with z whole months from first delivery to maturity.
+	template<class F = double>
+	inline F conversion(F c, unsigned z)
+	{
+		const unsigned n = z / 12;      // whole years
+		const unsigned q = z % 12 / 3 * 3; // months rounded down to a quarter
+		const unsigned v = q < 7 ? q : q - 6;
+		const F a = std::pow(F(1.03), -F(v) / 6);
+		const F b = c / 2 * F(6 - v) / 6;
+		const F d = std::pow(F(1.03), -F(q < 7 ? 2 * n : 2 * n + 1));
+		const F e = c / F(0.06) * (1 - d);
+
+		return a * (c / 2 + d + e) - b;
+	}
+	// Conversion factors of n bonds for a contract with first delivery t0.
+	template<class T, class F>
+	inline void conversion(size_t n, const F* c, const T* m, T t0, F* cf)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			// guard against months one ulp short of whole
+			const T z = std::floor(12 * (m[i] - t0) + T(1e-9));
+			cf[i] = z >= 0 ? conversion(c[i], static_cast<unsigned>(z)) : math::NaN<F>;
+		}
+	}
+
+	// Deliverable bonds with semiannual coupon schedules in years from valuation.
+	template<class T = double, class F = double>
+	struct basket {
+		std::vector<F> coupon;
+		std::vector<T> maturity;
+		std::vector<size_t> o; // bond i pays at u[o[i]..o[i + 1])
+		std::vector<T> u;
+		std::vector<F> c;
+
+		basket()
+			: o{ 0 }
+		{ }
+
+		size_t size() const
+		{
+			return coupon.size();
+		}
+		basket& push_back(F c_, T m)
+		{
+			ensure(m > 0);
+
+			coupon.push_back(c_);
+			maturity.push_back(m);
+			const size_t k = static_cast<size_t>(std::ceil(2 * m - T(1e-9)));
+			for (size_t j = k; j-- > 0; ) {
+				u.push_back(m - T(0.5) * j);
+				c.push_back(c_ / 2 + (j == 0));
+			}
+			o.push_back(u.size());
+
+			return *this;
+		}
+
+		// Accrued interest of bond i at t since the last coupon paid at or before t.
+		F accrued(size_t i, T t) const
+		{
+			const T* b = u.data() + o[i];
+			const T* e = u.data() + o[i + 1];
+			const T* next = std::upper_bound(b, e, t);
+			if (next == e) {
+				return 0;
+			}
+
+			return coupon[i] * (t - (*next - T(0.5)));
+		}
+
+		// Clean prices of all bonds on f using the library present value of each schedule.
+		template<class F_>
+		void price(const curve::base<T, F_>& f, F* p) const
+		{
+			for (size_t i = 0; i < size(); ++i) {
+				p[i] = value::present(o[i + 1] - o[i], u.data() + o[i], c.data() + o[i], f) - accrued(i, 0);
+			}
+		}
+	};
+
+	// Analytics of one bond against one contract.
+	template<class F = double>
+	struct result {
+		F cf;    // conversion factor
+		F gross; // gross basis
+		F carry;
+		F net;   // net basis
+		F repo;  // implied repo
+	};
+
+	// Contract with first delivery t0, delivery T, futures price f and repo r against every bond
+	// of b with clean price p. Put basket results in x[0..b.size()) and return the index of the
+	// cheapest to deliver. Bonds maturing before delivery get NaN and are never cheapest.
+	// Returns b.size() if no bond matures after delivery.
+	template<class T, class F>
+	inline size_t analyze(const basket<T, F>& b, const F* p, T t0, T T_, F f, F r, result<F>* x)
+	{
+		ensure(0 < T_ && t0 <= T_);
+
+		const size_t n = b.size();
+		std::vector<F> cf(n);
+		conversion(n, b.coupon.data(), b.maturity.data(), t0, cf.data());
+
+		size_t ctd = n;
+		for (size_t i = 0; i < n; ++i) {
+			if (!(b.maturity[i] > T_)) {
+				x[i] = result<F>{ cf[i], math::NaN<F>, math::NaN<F>, math::NaN<F>, math::NaN<F> };
+				continue;
+			}
+			// coupons paid in (0, T]
+			F C = 0, CT = 0;
+			for (size_t j = b.o[i]; j < b.o[i + 1] && b.u[j] <= T_; ++j) {
+				C += b.c[j];
+				CT += b.c[j] * (T_ - b.u[j]);
+			}
+			const F a0 = b.accrued(i, 0), aT = b.accrued(i, T_);
+			const F S = p[i] + a0;
+
+			x[i].cf = cf[i];
+			x[i].gross = p[i] - f * cf[i];
+			x[i].carry = aT - a0 + C + r * CT - S * r * T_;
+			x[i].net = x[i].gross - x[i].carry;
+			x[i].repo = (f * cf[i] + aT + C - S) / (S * T_ - CT);
+			if (ctd == n || x[i].repo > x[ctd].repo) {
+				ctd = i;
+			}
+		}
+
+		return ctd;
+	}
+
+	// K contracts against the basket, results for contract k in x[k n .. (k + 1) n) and cheapest to deliver in ctd[k].
+	template<class T, class F>
+	inline void analyze(const basket<T, F>& b, const F* p, size_t K, const T* t0, const T* T_, const F* f, const F* r,
+		result<F>* x, size_t* ctd, unsigned threads = parallel::concurrency())
+	{
+		parallel::for_each(K, [&](size_t k) {
+			ctd[k] = analyze(b, p, t0[k], T_[k], f[k], r[k], x + k * b.size());
+		}, threads);
+	}
+
+#ifdef _DEBUG
+	inline int analyze_test()
+	{
+		{
+			// 6% coupon converts at par on whole half years
+			for (unsigned z : { 0u, 6u, 20u, 120u, 248u, 354u }) {
+				assert(math::fabs(conversion(0.06, z) - 1) < 1e-14);
+			}
+			// clean price at 6% semiannual of the quarter rounded bond
+			for (double c : { 0.01, 0.025, 0.04, 0.0875 }) {
+				for (unsigned z = 24; z < 360; z += 7) {
+					const unsigned q = z / 3 * 3;
+					const double τ = q / 12.;
+					const size_t N = static_cast<size_t>(std::ceil(2 * τ - 1e-9));
+					const double f0 = 2 * τ - (N - 1); // periods to first coupon
+					double P = 1 / std::pow(1.03, f0 + N - 1);
+					for (size_t j = 0; j < N; ++j) {
+						P += c / 2 / std::pow(1.03, f0 + j);
+					}
+					P -= c / 2 * (1 - f0);
+					assert(math::fabs(conversion(c, z) - P) < 1e-12);
+				}
+			}
+		}
+
+		const double tk[] = { 1, 2, 5, 10, 30 };
+		const double fk[] = { 0.04, 0.041, 0.042, 0.044, 0.046 };
+		const curve::pwflat<> f(5, tk, fk, 0.046);
+
+		// bonds maturing from 6 to 10 years
+		basket<> b;
+		for (size_t i = 0; i < 40; ++i) {
+			b.push_back(0.02 + 0.001 * (i % 30), 6 + 0.1 * i);
+		}
+		const size_t n = b.size();
+		std::vector<double> p(n);
+		b.price(f, p.data());
+		for (size_t i = 0; i < n; ++i) {
+			// dirty price is the present value of the schedule
+			const double pv = value::present(b.o[i + 1] - b.o[i], b.u.data() + b.o[i], b.c.data() + b.o[i], f);
+			assert(p[i] + b.accrued(i, 0) == pv);
+		}
+		{
+			// coupon at the semiannual equivalent of a flat curve prices at par
+			const double y = 0.05;
+			const curve::constant<> g(y);
+			basket<> a;
+			a.push_back(2 * std::expm1(y / 2), 5.);
+			double q;
+			a.price(g, &q);
+			assert(math::fabs(q - 1) < 1e-14);
+		}
+
+		{
+			// futures at the forward price of bond 7 at repo r has implied repo r and no net basis
+			const double t0 = 0.2, T = 0.25, r = 0.045;
+			const size_t i = 7;
+			double C = 0, CT = 0;
+			for (size_t j = b.o[i]; j < b.o[i + 1] && b.u[j] <= T; ++j) {
+				C += b.c[j];
+				CT += b.c[j] * (T - b.u[j]);
+			}
+			const double S = p[i] + b.accrued(i, 0);
+			const double fwd = S * (1 + r * T) - C - r * CT - b.accrued(i, T);
+			const double cf = conversion(b.coupon[i], unsigned(std::floor(12 * (b.maturity[i] - t0) + 1e-9)));
+			std::vector<result<>> x(n);
+			const size_t ctd = analyze(b, p.data(), t0, T, fwd / cf, r, x.data());
+			assert(math::fabs(x[i].cf - cf) < 1e-15);
+			assert(math::fabs(x[i].repo - r) < 1e-12);
+			assert(math::fabs(x[i].net) < 1e-14);
+			for (size_t k = 0; k < n; ++k) {
+				assert(x[k].repo <= x[ctd].repo);
+				assert(math::fabs(x[k].net - (x[k].gross - x[k].carry)) < 1e-15);
+			}
+		}
+		{
+			// contract months share the basket
+			const size_t K = 8;
+			std::vector<double> t0(K), T(K), F(K), r(K, 0.045);
+			for (size_t k = 0; k < K; ++k) {
+				t0[k] = 0.25 * k + 0.2;
+				T[k] = 0.25 * k + 0.25;
+				F[k] = 0.95 - 0.002 * k;
+			}
+			std::vector<result<>> x(K * n), y(n);
+			std::vector<size_t> ctd(K);
+			analyze(b, p.data(), K, t0.data(), T.data(), F.data(), r.data(), x.data(), ctd.data(), 3);
+			for (size_t k = 0; k < K; ++k) {
+				assert(ctd[k] == analyze(b, p.data(), t0[k], T[k], F[k], r[k], y.data()));
+				for (size_t i = 0; i < n; ++i) {
+					assert(x[k * n + i].repo == y[i].repo);
+				}
+			}
+		}
+		{
+			// empty deliverable set
+			std::vector<result<>> x(n);
+			assert(n == analyze(b, p.data(), 10.5, 11., 1., 0.04, x.data()));
+			assert(std::isnan(x[0].repo));
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::futures
@@ -0,0 +1,310 @@
+// tmx_graph.h - Lazy dependency graph of analytics.
+// Inputs (quotes, notionals, ...) feed nodes computed from other nodes
+// (curves, spread curves, present values, aggregated risk). Setting an input
+// marks its descendants dirty. Asking for a node recomputes only the dirty
+// nodes it depends on, level by level, optionally in parallel on a pool.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include "tmx_curve_pwflat.h"
+#include "tmx_value.h"
+#endif // _DEBUG
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "ensure.h"
+#include "tmx_scheduler.h"
+
+namespace tmx::graph {
+
+	class dag;
+
+	// Type erased node.
+	class node_base {
+		friend class dag;
+		std::vector<node_base*> in, out;
+		size_t id = 0; // creation order is a topological order
+	protected:
+		bool dirty = true;
+		virtual void compute() = 0;
+	public:
+		virtual ~node_base()
+		{ }
+
+		// True if the value must be recomputed.
+		bool stale() const
+		{
+			return dirty;
+		}
+	};
+
+	// Value set from outside the graph.
+	template<class X>
+	class input : public node_base {
+		friend class dag;
+		X x;
+		void compute() override
+		{ }
+	public:
+		using value_type = X;
+
+		input(X x)
+			: x(std::move(x))
+		{
+			dirty = false;
+		}
+
+		const X& value() const
+		{
+			return x;
+		}
+	};
+
+	// Value computed from other nodes.
+	template<class X>
+	class node : public node_base {
+		friend class dag;
+		std::function<X()> f;
+		std::optional<X> x;
+		size_t n = 0; // number of evaluations
+		void compute() override
+		{
+			x.emplace(f());
+			++n;
+		}
+	public:
+		using value_type = X;
+
+		const X& value() const
+		{
+			ensure(x);
+
+			return *x;
+		}
+		size_t count() const
+		{
+			return n;
+		}
+	};
+
+	class dag {
+		std::vector<std::unique_ptr<node_base>> ns;
+
+		template<class N>
+		N& add(std::unique_ptr<N> p)
+		{
+			N& n = *p;
+			n.id = ns.size();
+			ns.push_back(std::move(p));
+
+			return n;
+		}
+		static void link(node_base& n, node_base& i)
+		{
+			n.in.push_back(&i);
+			i.out.push_back(&n);
+		}
+		static void invalidate(node_base& n)
+		{
+			for (node_base* o : n.out) {
+				if (!o->dirty) {
+					o->dirty = true;
+					invalidate(*o);
+				}
+			}
+		}
+	public:
+		dag() = default;
+		dag(const dag&) = delete;
+		dag& operator=(const dag&) = delete;
+		~dag() = default;
+
+		size_t size() const
+		{
+			return ns.size();
+		}
+
+		// Add an input node.
+		template<class X>
+		graph::input<X>& input(X x)
+		{
+			return add(std::make_unique<graph::input<X>>(std::move(x)));
+		}
+
+		// Add a node computing f(n.value()...).
+		template<class F, class... N>
+		auto& node(F f, N&... n)
+		{
+			using X = std::invoke_result_t<F, const typename N::value_type&...>;
+
+			auto p = std::make_unique<graph::node<X>>();
+			p->f = [f, &n...]() { return f(n.value()...); };
+			(link(*p, n), ...);
+
+			return add(std::move(p));
+		}
+
+		// Add a node folding op over the values of ns starting from x.
+		template<class X, class Op, class N>
+		auto& reduce(X x, Op op, const std::vector<N*>& ns_)
+		{
+			auto p = std::make_unique<graph::node<X>>();
+			p->f = [x, op, ns_]() {
+				X y = x;
+				for (const N* n : ns_) {
+					y = op(y, n->value());
+				}
+				return y;
+			};
+			for (N* n : ns_) {
+				link(*p, *n);
+			}
+
+			return add(std::move(p));
+		}
+
+		// Change an input and mark everything downstream dirty.
+		template<class X>
+		void set(graph::input<X>& i, X x)
+		{
+			i.x = std::move(x);
+			invalidate(i);
+		}
+
+		// Recompute dirty nodes that targets depend on, in parallel if p is not null.
+		void evaluate(const std::vector<node_base*>& targets, scheduler::pool* p = nullptr)
+		{
+			// dirty ancestors of targets
+			std::vector<bool> need(ns.size(), false);
+			std::vector<node_base*> stack;
+			for (node_base* t : targets) {
+				if (t->dirty && !need[t->id]) {
+					need[t->id] = true;
+					stack.push_back(t);
+				}
+			}
+			while (!stack.empty()) {
+				node_base* n = stack.back();
+				stack.pop_back();
+				for (node_base* i : n->in) {
+					if (i->dirty && !need[i->id]) {
+						need[i->id] = true;
+						stack.push_back(i);
+					}
+				}
+			}
+
+			// Levels in creation order. Nodes in a level do not depend on each other.
+			std::vector<size_t> level(ns.size(), 0);
+			std::vector<std::vector<node_base*>> levels;
+			for (size_t k = 0; k < ns.size(); ++k) {
+				if (!need[k]) {
+					continue;
+				}
+				node_base* n = ns[k].get();
+				for (node_base* i : n->in) {
+					if (need[i->id]) {
+						level[k] = std::max(level[k], level[i->id] + 1);
+					}
+				}
+				if (levels.size() <= level[k]) {
+					levels.resize(level[k] + 1);
+				}
+				levels[level[k]].push_back(n);
+			}
+
+			for (const auto& l : levels) {
+				if (p && l.size() > 1) {
+					scheduler::group g(*p);
+					for (node_base* n : l) {
+						g.run([n] { n->compute(); });
+					}
+					g.wait();
+				}
+				else {
+					for (node_base* n : l) {
+						n->compute();
+					}
+				}
+				for (node_base* n : l) {
+					n->dirty = false;
+				}
+			}
+		}
+
+		// Up to date value of n.
+		template<class N>
+		const auto& get(N& n, scheduler::pool* p = nullptr)
+		{
+			evaluate({ &n }, p);
+
+			return n.value();
+		}
+	};
+
+#ifdef _DEBUG
+	// quotes -> curve -> spread curve -> present values -> total
+	inline int dag_test()
+	{
+		using curve_t = curve::pwflat<>;
+
+		static double t[] = { 1, 2, 3 };
+		static double u0[] = { 1, 2 }, c0[] = { 0.05, 1.05 };
+		static double u1[] = { 1, 2, 3 }, c1[] = { 0.04, 0.04, 1.04 };
+
+		for (int threads : { 0, 4 }) {
+			std::unique_ptr<scheduler::pool> p;
+			if (threads) {
+				p = std::make_unique<scheduler::pool>(threads);
+			}
+			dag g;
+			auto& quotes = g.input(std::vector<double>{ 0.03, 0.04, 0.05 });
+			auto& spread = g.input(0.01);
+			auto& notional = g.input(2.);
+			auto& f = g.node([](const std::vector<double>& q) { return curve_t(q.size(), t, q.data(), q.back()); }, quotes);
+			auto& fs = g.node([](const curve_t& f, double s) {
+				std::vector<double> q(3);
+				for (size_t i = 0; i < 3; ++i) {
+					q[i] = f.value(t[i]) + s;
+				}
+				return curve_t(3, t, q.data(), q.back());
+			}, f, spread);
+			auto& pv0 = g.node([](const curve_t& f) { return value::present(2, u0, c0, f); }, fs);
+			auto& pv1 = g.node([](const curve_t& f, double n) { return n * value::present(3, u1, c1, f); }, fs, notional);
+			auto& total = g.reduce(0., std::plus<double>{}, std::vector{ &pv0, &pv1 });
+			assert(8 == g.size());
+
+			double v = g.get(total, p.get());
+			assert(1 == f.count() && 1 == fs.count() && 1 == pv0.count() && 1 == pv1.count());
+			assert(v == pv0.value() + pv1.value());
+			assert(v == g.get(total, p.get()));
+			assert(1 == total.count());
+
+			// notional only affects pv1 and total
+			g.set(notional, 1.);
+			assert(!pv0.stale() && pv1.stale() && total.stale());
+			double v1 = g.get(total, p.get());
+			assert(1 == fs.count() && 1 == pv0.count() && 2 == pv1.count());
+			assert(math::fabs(v1 - (v - pv1.value())) < 1e-12);
+
+			// spread leaves the base curve alone
+			g.set(spread, 0.);
+			g.evaluate({ &pv0 }, p.get());
+			assert(1 == f.count() && 2 == fs.count() && 2 == pv0.count() && 2 == pv1.count());
+			assert(pv1.stale() && total.stale());
+			g.get(total, p.get());
+			assert(3 == pv1.count() && 3 == total.count());
+
+			g.set(quotes, std::vector<double>{ 0.02, 0.03, 0.04 });
+			double v2 = g.get(total, p.get());
+			assert(2 == f.count() && 3 == fs.count());
+			assert(v2 > v1);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::graph
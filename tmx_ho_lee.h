@@ -10,11 +10,20 @@
 // E[log D_t(u)] = log(D(u)/D(t)) - σ^2 ut (u - t)/2
 // Var(log D_t(u)) = σ^2 (u - t)^2 t
 #pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
 #include <cmath>
 #include <utility>
-#include "tmx_black.h"
+#include <algorithm>
+#include <numbers>
+#include <tuple>
+#include <vector>
+#include "tmx_option.h"
 #include "tmx_curve.h"
-#include "tmx_instrument.h"
+#ifdef _DEBUG
+#include "tmx_curve_pwflat.h"
+#endif // _DEBUG
 
 namespace tmx::ho_lee {
 
@@ -87,13 +96,13 @@ namespace tmx::ho_lee {
 	//   = E[f(sum_{u_j > t} c_j D_t(u_j) e^C_j)] E[D_t],
 	// where C_j = Cov(log D_t(u_j), log D_t)
 
-	// mean and variance of P_t = sum_{u_j > t} c_j D_t(u_j) e^C_j
+	// mean and log variance of P_t = sum_{u_j > t} c_j D_t(u_j) e^C_j
 	template<class U, class C, class T, class F>
 	inline std::pair<F, F> moments(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t, F σ)
 	{
 		F mean = 0, var = 0;
 
-		auto j0 = view(c, c + m).upper_index(t);
+		const size_t j0 = std::upper_bound(u, u + m, t) - u;
 
 		auto Dt = f.discount(t);
 		for (auto j = j0; j < m; ++j) {
@@ -106,8 +115,8 @@ namespace tmx::ho_lee {
 				var += c[j] * c[k] * CovD(Dt, Duj, Duk, t, u[j], u[k], σ) * Cj * Ck;
 			}
 		}
-		// Var(e^N) = E[e^N]^2 (e^Var(N) - 1)
-		var = std::log(var / (mean * mean) + 1);
+		// var is E[P_t^2] and E[e^N]^2 = E[e^N]^2 e^Var(N)
+		var = std::log(var / (mean * mean));
 
 		return { mean, var };
 	}
@@ -123,12 +132,385 @@ namespace tmx::ho_lee {
 	// E[(P_t - p)^+ D_t] 
 	// = E[(sum_{u_j > t} c_j D_t(u_j) - p)^+ D_t]
 	// = E[(sum_{u_j > t} c_j D_t(u_j) exp(σ^2(u_j - t) - p)^+] D(t)
+	// Approximates P_t as lognormal with matching moments. O(m^2).
 	template<class U, class C, class T, class F>
-	inline F option(const instrument::base<U, C>& i, const curve::base<T, F>& f, T t, F σ, F p)
+	inline F option(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t, F σ, F p)
 	{
-		auto [m, m_, v] = moments(i, f, t, σ);
-		// σ += cov!!!
-		return black::call::value(m_, std::sqrt(v), p) * f.discount(t);
+		auto [m_, v] = moments(m, u, c, f, t, σ);
+
+		return option::call::value(m_, std::sqrt(v), p) * f.discount(t);
+	}
+
+	// Jamshidian decomposition.
+	// D_t(u) = A(u) exp(-σ(u - t)B_t) with A(u) = exp(E[log D_t(u)]) is decreasing in B_t, so
+	// P_t = p exactly when B_t = b, and (P_t - p)^+ = sum_j c_j (D_t(u_j) - p_j)^+ with p_j = D_t(u_j) at b.
+	// Under the t-forward measure log D_t(u) is normal with mean log(D(u)/D(t)) - s^2/2
+	// and variance s^2 = σ^2 (u - t)^2 t, so each term is a Black call.
+	// E[(P_t - p)^+ D_t] = D(t) sum_j c_j Black(D(u_j)/D(t), σ(u_j - t) sqrt(t), p_j)
+
+	// Critical value b with sum_j c_j A_j exp(-β_j b) = p. Requires c_j >= 0.
+	// A strike p <= 0 is never reached and the option is always exercised, b = infinity.
+	template<class C, class F>
+	inline F critical(size_t m, const C* c, const F* A, const F* β, F p,
+		F tol = math::sqrt_epsilon<F>, int iter = 100)
+	{
+		if (p <= 0) {
+			return math::infinity<F>;
+		}
+
+		const auto P = [=](F b) {
+			F v = 0, dv = 0;
+			for (size_t j = 0; j < m; ++j) {
+				const F e = c[j] * A[j] * std::exp(-β[j] * b);
+				v += e;
+				dv -= β[j] * e;
+			}
+			return std::pair<F, F>(v, dv);
+		};
+
+		// Start left of the root. P is decreasing and convex so Newton then converges monotonically.
+		F b = 0, step = 1;
+		auto [v, dv] = P(b);
+		while (v < p && iter-- > 0) {
+			b -= step;
+			step *= 2;
+			std::tie(v, dv) = P(b);
+		}
+		while (iter-- > 0) {
+			const F db = (v - p) / dv;
+			b -= db;
+			std::tie(v, dv) = P(b);
+			if (math::fabs(db) <= tol) {
+				return b;
+			}
+		}
+
+		return math::NaN<F>;
+	}
+
+	// Black inputs of the Jamshidian terms of a call expiring at t with strike p on cash flows
+	// c_j at u_j > t, j < m, given Dt = D(t) and Du_j = D(u_j). Put forwards in fw, vols in s and
+	// critical strikes in k and return true. If the call has no time value put its intrinsic value
+	// in x, fill the inputs with neutral ones and return false. Shared by every Jamshidian pricer.
+	template<class U, class C, class T, class F>
+	inline bool jamshidian_terms(size_t m, const U* u, const C* c, T t, F Dt, const F* Du, F σ, F p,
+		F* fw, F* s, F* k, F& x)
+	{
+		// k holds A_j and s holds β_j until the critical value is known
+		F fwd = 0;
+		for (size_t j = 0; j < m; ++j) {
+			fw[j] = Du[j] / Dt;
+			k[j] = std::exp(ELogD(Dt, Du[j], t, u[j], σ));
+			s[j] = σ * (u[j] - t);
+			fwd += c[j] * fw[j];
+		}
+		if (m == 0 || σ == 0 || t == 0 || p <= 0) {
+			x = Dt * std::max(fwd - p, F(0));
+			std::fill(fw, fw + m, F(1));
+			std::fill(s, s + m, F(1));
+			std::fill(k, k + m, F(1));
+			return false;
+		}
+
+		const F b = critical(m, c, k, s, p);
+		const F sqrt_t = std::sqrt(t);
+		for (size_t j = 0; j < m; ++j) {
+			k[j] *= std::exp(-s[j] * b);
+			s[j] *= sqrt_t;
+		}
+
+		return true;
+	}
+
+	// Value of call expiring at t with strike p on cash flows c_j at u_j > t. O(m).
+	template<class U, class C, class T, class F>
+	inline F jamshidian(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t, F σ, F p)
+	{
+		const size_t j0 = std::upper_bound(u, u + m, t) - u;
+		u += j0;
+		c += j0;
+		m -= j0;
+
+		const F Dt = f.discount(t);
+		std::vector<F> Du(m), fw(m), s(m), k(m), v(m);
+		for (size_t j = 0; j < m; ++j) {
+			Du[j] = f.discount(u[j]);
+		}
+		F x;
+		if (!jamshidian_terms(m, u, c, t, Dt, Du.data(), σ, p, fw.data(), s.data(), k.data(), x)) {
+			return x;
+		}
+		option::call::value(m, fw.data(), s.data(), k.data(), v.data());
+
+		F value = 0;
+		for (size_t j = 0; j < m; ++j) {
+			value += c[j] * v[j];
+		}
+
+		return Dt * value;
+	}
+
+	// Batch calls with expiries t[i] and strikes p[i] on the same cash flows, e.g. a call schedule.
+	// Discounts D(u_j) are computed once and all Black terms go through one vectorized call.
+	template<class U, class C, class T, class F>
+	inline void jamshidian(size_t m, const U* u, const C* c, const curve::base<T, F>& f, F σ,
+		size_t n, const T* t, const F* p, F* value)
+	{
+		std::vector<F> Du(m);
+		for (size_t j = 0; j < m; ++j) {
+			Du[j] = f.discount(u[j]);
+		}
+
+		// one row of Black terms per option
+		std::vector<size_t> row(n + 1, 0), j0(n);
+		for (size_t i = 0; i < n; ++i) {
+			j0[i] = std::upper_bound(u, u + m, t[i]) - u;
+			row[i + 1] = row[i] + (m - j0[i]);
+		}
+		const size_t N = row[n];
+		std::vector<F> Dt(n), fw(N), s(N), k(N), v(N);
+		std::vector<bool> intrinsic(n, false);
+		for (size_t i = 0; i < n; ++i) {
+			const size_t r = row[i];
+			Dt[i] = f.discount(t[i]);
+			intrinsic[i] = !jamshidian_terms(m - j0[i], u + j0[i], c + j0[i], t[i], Dt[i], Du.data() + j0[i], σ, p[i],
+				fw.data() + r, s.data() + r, k.data() + r, value[i]);
+		}
+		option::call::value(N, fw.data(), s.data(), k.data(), v.data());
+		for (size_t i = 0; i < n; ++i) {
+			if (intrinsic[i]) {
+				continue;
+			}
+			F x = 0;
+			for (size_t j = j0[i]; j < m; ++j) {
+				x += c[j] * v[row[i] - j0[i] + j];
+			}
+			value[i] = Dt[i] * x;
+		}
+	}
+
+	// Jamshidian price and sensitivities computed in the same pass.
+	// Holding the critical strikes p_j fixed is exact for first derivatives: every term
+	// is exercised on the same event {B_t < b}, so dV/dp_j is proportional to c_j and
+	// sum_j c_j dp_j = dp = 0.
+	template<class U = double, class F = double>
+	struct greeks {
+		F value = 0;
+		U t = 0;             // expiry
+		F Dt = 1, dDt = 0;   // D(t) and dV/dD(t)
+		std::vector<U> u;    // flow times after expiry
+		std::vector<F> Du;   // D(u_j)
+		std::vector<F> dDu;  // dV/dD(u_j)
+		F vega = 0;          // dV/dσ
+		F theta = 0;         // dV/dt, curve fixed
+
+		// Sensitivities to the forwards of a piecewise flat curve with knots tk[0] < ... < tk[n - 1].
+		// out[i] = dV/df_i for i < n and out[n] is the extrapolated forward.
+		// Uses dD(x)/df_i = -D(x) |(tk[i - 1], tk[i]] ∩ (0, x]|.
+		void knots(size_t n, const U* tk, F* out) const
+		{
+			std::fill(out, out + n + 1, F(0));
+			const auto add = [n, tk, out](U x, F w) {
+				U t0 = 0;
+				for (size_t i = 0; i < n && t0 < x; ++i) {
+					out[i] -= w * (std::min(x, tk[i]) - t0);
+					t0 = tk[i];
+				}
+				if (x > t0) {
+					out[n] -= w * (x - t0);
+				}
+			};
+			add(t, dDt * Dt);
+			for (size_t j = 0; j < u.size(); ++j) {
+				add(u[j], dDu[j] * Du[j]);
+			}
+		}
+	};
+
+	template<class U, class C, class T, class F>
+	inline greeks<U, F> jamshidian_greeks(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t, F σ, F p)
+	{
+		const size_t j0 = std::upper_bound(u, u + m, t) - u;
+		u += j0;
+		c += j0;
+		m -= j0;
+
+		greeks<U, F> g;
+		g.t = t;
+		g.Dt = f.discount(t);
+		g.u.assign(u, u + m);
+		g.Du.resize(m);
+		g.dDu.resize(m);
+
+		const F sqrt_t = std::sqrt(t);
+		std::vector<F> A(m), β(m);
+		F fwd = 0;
+		for (size_t j = 0; j < m; ++j) {
+			g.Du[j] = f.discount(u[j]);
+			A[j] = std::exp(ELogD(g.Dt, g.Du[j], t, u[j], σ));
+			β[j] = σ * (u[j] - t);
+			fwd += c[j] * g.Du[j] / g.Dt;
+		}
+		if (m == 0 || σ == 0 || t == 0 || p <= 0) {
+			// intrinsic
+			const bool itm = fwd > p;
+			g.value = g.Dt * std::max(fwd - p, F(0));
+			g.dDt = itm ? -p : F(0);
+			for (size_t j = 0; j < m; ++j) {
+				g.dDu[j] = itm ? F(c[j]) : F(0);
+			}
+			g.theta = g.dDt * -f.value(t) * g.Dt;
+			return g;
+		}
+
+		const F b = critical(m, c, A.data(), β.data(), p);
+		const F r = f.value(t); // dD(t)/dt = -r D(t)
+		constexpr F sqrt1_2 = F(1) / std::numbers::sqrt2_v<F>;
+		const F one_sqrt2pi = F(1) / std::sqrt(2 * std::numbers::pi_v<F>);
+		for (size_t j = 0; j < m; ++j) {
+			const F fw = g.Du[j] / g.Dt;
+			const F k = A[j] * std::exp(-β[j] * b);
+			const F s = β[j] * sqrt_t;
+			const F d2 = (std::log(fw / k) - s * s / 2) / s;
+			const F N1 = std::erfc(-(d2 + s) * sqrt1_2) / 2;
+			const F N2 = std::erfc(-d2 * sqrt1_2) / 2;
+			const F vega = k * std::exp(-d2 * d2 / 2) * one_sqrt2pi; // dBlack/ds
+
+			g.value += c[j] * (g.Du[j] * N1 - g.Dt * k * N2);
+			g.dDu[j] = c[j] * N1;
+			g.dDt -= c[j] * k * N2;
+			g.vega += c[j] * g.Dt * vega * (u[j] - t) * sqrt_t;
+			g.theta += c[j] * g.Dt * vega * σ * ((u[j] - t) / (2 * sqrt_t) - sqrt_t);
+		}
+		g.theta += g.dDt * -r * g.Dt;
+
+		return g;
+	}
+
+#ifdef _DEBUG
+	inline int jamshidian_greeks_test()
+	{
+		const double tk[] = { 1, 2, 3, 5 };
+		const double fk[] = { 0.03, 0.035, 0.04, 0.045 };
+		const double _f = 0.05;
+		const curve::pwflat<> f(4, tk, fk, _f);
+		const double u[] = { 0.5, 1, 1.5, 2, 2.5, 3, 3.5, 4, 4.5, 5, 5.5, 6 };
+		const double c[] = { 0.02, 0.02, 0.02, 0.02, 0.02, 0.02, 0.02, 0.02, 0.02, 0.02, 0.02, 1.02 };
+		const double σ = 0.01, t = 1.75, p = 0.98;
+
+		const auto g = jamshidian_greeks(12, u, c, f, t, σ, p);
+		assert(math::fabs(g.value - jamshidian(12, u, c, f, t, σ, p)) < 1e-14);
+		assert(g.value > 0);
+
+		const double h = 1e-6;
+		const double vega = (jamshidian(12, u, c, f, t, σ + h, p) - jamshidian(12, u, c, f, t, σ - h, p)) / (2 * h);
+		assert(math::fabs(g.vega - vega) < 1e-6);
+		const double theta = (jamshidian(12, u, c, f, t + h, σ, p) - jamshidian(12, u, c, f, t - h, σ, p)) / (2 * h);
+		assert(math::fabs(g.theta - theta) < 1e-6);
+
+		double dk[5];
+		g.knots(4, tk, dk);
+		for (size_t i = 0; i <= 4; ++i) {
+			double fu[4], fd[4];
+			std::copy(fk, fk + 4, fu);
+			std::copy(fk, fk + 4, fd);
+			double _fu = _f, _fd = _f;
+			if (i < 4) {
+				fu[i] += h;
+				fd[i] -= h;
+			}
+			else {
+				_fu += h;
+				_fd -= h;
+			}
+			const curve::pwflat<> up(4, tk, fu, _fu), dn(4, tk, fd, _fd);
+			const double d = (jamshidian(12, u, c, up, t, σ, p) - jamshidian(12, u, c, dn, t, σ, p)) / (2 * h);
+			assert(math::fabs(dk[i] - d) < 1e-6);
+		}
+
+		return 0;
+	}
+
+	inline int jamshidian_test()
+	{
+		const curve::constant<> f(0.04);
+		const double σ = 0.01;
+		{
+			// zero coupon bond options are lognormal so all methods agree
+			const double u[] = { 5 };
+			const double c[] = { 1 };
+			const double t = 2, p = std::exp(-0.04 * 3);
+			const double j = jamshidian(1, u, c, f, t, σ, p);
+			const double o = option(1, u, c, f, t, σ, p);
+			assert(math::fabs(j - o) < 1e-12);
+			const double b = f.discount(t) * option::call::value(f.discount(5) / f.discount(t), σ * 3 * std::sqrt(t), p);
+			assert(math::fabs(j - b) < 1e-12);
+		}
+		{
+			// coupon bond against quadrature over B_t ~ N(-σ t^2/2, t) under the t-forward measure
+			const double u[] = { 0.5, 1, 1.5, 2, 2.5, 3, 3.5, 4, 4.5, 5 };
+			const double c[] = { 0.025, 0.025, 0.025, 0.025, 0.025, 0.025, 0.025, 0.025, 0.025, 1.025 };
+			const double t = 2.25;
+			const double Dt = f.discount(t);
+			double fwd = 0;
+			for (size_t j = 0; j < 10; ++j) {
+				fwd += u[j] > t ? c[j] * f.discount(u[j]) / Dt : 0;
+			}
+			for (double p : { 0.98 * fwd, fwd, 1.02 * fwd }) {
+				const double j = jamshidian(10, u, c, f, t, σ, p);
+
+				const double mu = -σ * t * t / 2, sd = std::sqrt(t);
+				const int n = 20'000;
+				const double h = 16 * sd / n;
+				double q = 0;
+				for (int i = 0; i <= n; ++i) {
+					const double b = mu - 8 * sd + i * h;
+					double P = 0;
+					for (size_t k = 0; k < 10; ++k) {
+						if (u[k] > t) {
+							P += c[k] * std::exp(ELogD(Dt, f.discount(u[k]), t, u[k], σ) - σ * (u[k] - t) * b);
+						}
+					}
+					const double w = (i == 0 || i == n) ? 0.5 : 1;
+					q += w * std::max(P - p, 0.) * std::exp(-(b - mu) * (b - mu) / (2 * t)) / std::sqrt(2 * M_PI * t) * h;
+				}
+				q *= Dt;
+				assert(math::fabs(j - q) < 1e-9);
+				// moment matching is close but not exact
+				assert(math::fabs(j - option(10, u, c, f, t, σ, p)) < 1e-4);
+			}
+
+			// batch across expiries and strikes
+			const double ts[] = { 1, 2.25, 2.25, 4.75, 6, 0 };
+			const double ps[] = { 1, 0.98 * fwd, fwd, 1, 1, 1 };
+			double v[6];
+			jamshidian(10, u, c, f, σ, 6, ts, ps, v);
+			for (size_t i = 0; i < 6; ++i) {
+				assert(math::fabs(v[i] - jamshidian(10, u, c, f, ts[i], σ, ps[i])) < 1e-14);
+			}
+			assert(v[4] == 0);
+
+			// nonpositive strikes are always exercised
+			for (double p : { 0., -0.1 }) {
+				double A[10], β[10];
+				for (size_t j = 0; j < 10; ++j) {
+					A[j] = 1;
+					β[j] = σ * u[j];
+				}
+				assert(critical(10, c, A, β, p) == math::infinity<double>);
+				const double j = jamshidian(10, u, c, f, t, σ, p);
+				assert(math::fabs(j - Dt * (fwd - p)) < 1e-14);
+				const double ts_[] = { t };
+				const double ps_[] = { p };
+				double v_;
+				jamshidian(10, u, c, f, σ, 1, ts_, ps_, &v_);
+				assert(v_ == j);
+				assert(math::fabs(jamshidian_greeks(10, u, c, f, t, σ, p).value - j) < 1e-14);
+			}
+		}
+
+		return 0;
 	}
+#endif // _DEBUG
 
-}
+} // namespace tmx::ho_lee
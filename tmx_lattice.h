@@ -0,0 +1,671 @@
+// tmx_lattice.h - Recombining short rate lattices and backward induction.
+// A tree with n steps of size dt has nodes (i, j), 0 <= j <= i, and moves from
+// (i, j) to (i + 1, j) or (i + 1, j + 1) with probability 1/2. The one period
+// discount at a node is d(i, j) = exp(-r(i, j) dt).
+//
+// Shifting the curve by a constant h shifts every calibrated short rate by h,
+// so the shifted tree has discounts d(i, j) exp(-h dt). Valuations under
+// several parallel shifts are carried through a single backward pass with one
+// node discount and a per valuation multiplier.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <thread>
+#endif // _DEBUG
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include "ensure.h"
+#include "tmx_curve.h"
+#include "tmx_curve_handle.h"
+
+namespace tmx::lattice {
+
+	// Ho-Lee binomial tree r(i, j) = a[i] + σ sqrt(dt) (2j - i) calibrated to f.
+	template<class T = double, class F = double>
+	class ho_lee {
+		T dt;
+		F σ;
+		F q;              // exp(-σ dt^{3/2})
+		std::vector<F> e; // exp(-a[i] dt)
+	public:
+		// Tree on [0, T] with n steps reproducing discounts D(i dt).
+		ho_lee(const curve::base<T, F>& f, F σ, T T_, size_t n)
+			: dt(T_ / n), σ(σ), q(std::exp(-σ * dt * std::sqrt(dt))), e(n)
+		{
+			ensure(n > 0 && T_ > 0);
+
+			// Arrow-Debreu prices
+			std::vector<F> Q(n + 1, F(0)), Q_(n + 1);
+			Q[0] = 1;
+			for (size_t i = 0; i < n; ++i) {
+				// d(i, j) = e[i] q^{2j - i}
+				const F q2 = q * q;
+				F s = 0, x = std::pow(q, -F(i));
+				for (size_t j = 0; j <= i; ++j) {
+					s += Q[j] * x;
+					x *= q2;
+				}
+				const F D1 = f.discount(dt * (i + 1));
+				e[i] = D1 / s;
+
+				x = e[i] * std::pow(q, -F(i));
+				std::fill(Q_.begin(), Q_.begin() + i + 2, F(0));
+				for (size_t j = 0; j <= i; ++j) {
+					const F a = Q[j] * x / 2;
+					Q_[j] += a;
+					Q_[j + 1] += a;
+					x *= q2;
+				}
+				std::swap(Q, Q_);
+			}
+		}
+
+		size_t steps() const
+		{
+			return e.size();
+		}
+		T step() const
+		{
+			return dt;
+		}
+		T time(size_t i) const
+		{
+			return dt * i;
+		}
+		// Step closest to time u.
+		size_t index(T u) const
+		{
+			return static_cast<size_t>(std::llround(u / dt));
+		}
+		// Short rate at node (i, j).
+		F rate(size_t i, size_t j) const
+		{
+			return -std::log(e[i]) / dt + σ * std::sqrt(dt) * (F(2) * j - F(i));
+		}
+		// One period discount at node (i, j).
+		F discount(size_t i, size_t j) const
+		{
+			return e[i] * std::pow(q, F(2) * j - F(i));
+		}
+
+		// Number of nodes at step i and in total.
+		size_t size(size_t i) const
+		{
+			return i + 1;
+		}
+		size_t nodes() const
+		{
+			return e.size() + 1;
+		}
+
+		// Roll node values v at step i + 1 back to step i in w.
+		// Valuation k discounts with an extra factor g[k].
+		template<size_t K>
+		void roll(size_t i, const std::array<F, K>* v, std::array<F, K>* w, const std::array<F, K>& g) const
+		{
+			const F q2 = q * q;
+			F d = e[i] * std::pow(q, -F(i));
+			for (size_t j = 0; j <= i; ++j) {
+				for (size_t k = 0; k < K; ++k) {
+					w[j][k] = d * g[k] * (v[j][k] + v[j + 1][k]) / 2;
+				}
+				d *= q2;
+			}
+		}
+	};
+
+	// Backward induction of K valuations from step n to step 0 on tree t.
+	// v must have t.nodes() entries with the t.size(n) values at step n first.
+	// After rolling to step i, step(i, v) adjusts node values v[0..t.size(i)), e.g.
+	// adds cash flows or applies exercise. Valuation k uses the curve shifted by h[k].
+	template<size_t K, class Tree, class F, class Step>
+	inline std::array<F, K> backward(const Tree& t, std::vector<std::array<F, K>>& v, const std::array<F, K>& h, const Step& step)
+	{
+		const size_t n = t.steps();
+		ensure(v.size() == t.nodes());
+
+		std::array<F, K> g;
+		for (size_t k = 0; k < K; ++k) {
+			g[k] = std::exp(-h[k] * t.step());
+		}
+		std::vector<std::array<F, K>> w(v.size());
+		step(n, v.data());
+		for (size_t i = n; i-- > 0; ) {
+			t.roll(i, v.data(), w.data(), g);
+			std::swap(v, w);
+			step(i, v.data());
+		}
+
+		return v[0];
+	}
+
+	// Base value and values with the curve shifted up and down by h.
+	template<class F = double>
+	struct effective {
+		F value, up, down;
+		F h;
+
+		F duration() const
+		{
+			return -(up - down) / (2 * h * value);
+		}
+		F convexity() const
+		{
+			return (up - 2 * value + down) / (h * h * value);
+		}
+	};
+
+	// Cash flows and call prices of a callable bond mapped to the steps of a tree.
+	// Build once and reuse for every valuation on the same tree.
+	template<class F = double>
+	struct schedule {
+		std::vector<F> cash, call; // call is NaN where not callable
+
+		// Bond with cash flows c[j] at u[j] callable at tc[k] for price pc[k] after the coupon paid at tc[k].
+		// Times are rounded to the nearest step.
+		template<class Tree, class U, class C>
+		schedule(const Tree& t, size_t m, const U* u, const C* c, size_t nc, const U* tc, const C* pc)
+			: cash(t.steps() + 1, F(0)), call(t.steps() + 1, math::NaN<F>)
+		{
+			const size_t n = t.steps();
+			for (size_t j = 0; j < m; ++j) {
+				const size_t i = t.index(u[j]);
+				ensure(i <= n);
+				if (i > 0) {
+					cash[i] += c[j];
+				}
+			}
+			for (size_t k = 0; k < nc; ++k) {
+				const size_t i = t.index(tc[k]);
+				ensure(i <= n);
+				call[i] = pc[k];
+			}
+		}
+	};
+
+	// Bond with cash flows c[j] at u[j] callable at tc[k] for price pc[k] after the coupon paid at tc[k].
+	// Times are rounded to the nearest step. Value, effective duration and convexity from one pass.
+	template<class Tree, class U, class C, class F = double>
+	inline effective<F> callable(const Tree& t, size_t m, const U* u, const C* c,
+		size_t nc, const U* tc, const C* pc, F h = F(0.0001))
+	{
+		const schedule<F> s(t, m, u, c, nc, tc, pc);
+
+		std::vector<std::array<F, 3>> v(t.nodes(), { F(0), F(0), F(0) });
+		const auto x = backward<3>(t, v, { F(0), h, -h }, [&](size_t i, std::array<F, 3>* v) {
+			const bool exercise = !std::isnan(s.call[i]);
+			if (!exercise && s.cash[i] == 0) {
+				return;
+			}
+			for (size_t j = 0; j < t.size(i); ++j) {
+				for (size_t k = 0; k < 3; ++k) {
+					if (exercise) {
+						v[j][k] = std::min(v[j][k], s.call[i]);
+					}
+					v[j][k] += s.cash[i];
+				}
+			}
+		});
+
+		return effective<F>{ x[0], x[1], x[2], h };
+	}
+
+	// Value and dValue/ds of a callable bond discounted at the short rate plus a spread s.
+	// The spread is the node discount multiplier exp(-s dt). Carrying (V, dV/ds) through
+	// the roll with the same multiplier gives g d E[dV/ds] and the product rule only
+	// subtracts dt times the rolled value, so the derivative costs no extra induction.
+	template<class Tree, class F>
+	inline std::array<F, 2> spread(const Tree& t, const schedule<F>& s, F z)
+	{
+		const size_t n = t.steps();
+		const F dt = t.step();
+
+		std::vector<std::array<F, 2>> v(t.nodes(), { F(0), F(0) });
+		return backward<2>(t, v, { z, z }, [&](size_t i, std::array<F, 2>* v) {
+			const bool exercise = !std::isnan(s.call[i]);
+			for (size_t j = 0; j < t.size(i); ++j) {
+				if (i < n) {
+					v[j][1] -= dt * v[j][0];
+				}
+				if (exercise && v[j][0] > s.call[i]) {
+					v[j][0] = s.call[i];
+					v[j][1] = 0;
+				}
+				v[j][0] += s.cash[i];
+			}
+		});
+	}
+
+	// Option adjusted spread.
+	template<class F = double>
+	struct oas_result {
+		F spread, value, dvalue; // dvalue = dValue/dspread
+		size_t iter;             // backward inductions
+		bool converged;          // false if iter ran out, spread is the last iterate
+	};
+
+	// Spread over the tree short rates that prices the bond at p. Newton's method on one
+	// calibrated tree, each iteration is a single backward induction.
+	template<class Tree, class F>
+	inline oas_result<F> oas(const Tree& t, const schedule<F>& s, F p, F z = F(0), F tol = F(1e-12), size_t iter = 20)
+	{
+		oas_result<F> x{ z, math::NaN<F>, math::NaN<F>, 0, false };
+		while (x.iter < iter) {
+			const auto v = spread(t, s, x.spread);
+			++x.iter;
+			x.value = v[0];
+			x.dvalue = v[1];
+			ensure(x.dvalue < 0);
+			const F dz = (x.value - p) / x.dvalue;
+			x.spread -= dz;
+			if (math::fabs(dz) <= tol) {
+				x.converged = true;
+				break;
+			}
+		}
+
+		return x;
+	}
+	template<class Tree, class U, class C, class F = double>
+	inline oas_result<F> oas(const Tree& t, size_t m, const U* u, const C* c,
+		size_t nc, const U* tc, const C* pc, F p, F z = F(0))
+	{
+		return oas(t, schedule<F>(t, m, u, c, nc, tc, pc), p, z);
+	}
+
+	// Hull-White trinomial tree dr = (θ(t) - a r) dt + σ dB calibrated to f.
+	// r(i, j) = α[i] + j dx with dx = sqrt(3 Var) and |j| <= jmax. Nodes at the
+	// edges branch inward so the tree stops growing after jmax steps.
+	template<class T = double, class F = double>
+	class hull_white {
+		T dt;
+		F a, σ;
+		F dx;
+		size_t jmax;
+		std::vector<F> e;  // exp(-α[i] dt)
+		std::vector<F> qx; // exp(-j dx dt), j = -jmax, ..., jmax
+		std::vector<std::array<F, 3>> p; // probabilities to middle - 1, middle, middle + 1
+
+		size_t width(size_t i) const
+		{
+			return std::min(i, jmax);
+		}
+		// Middle child of node j.
+		static long middle(long j, long jmax)
+		{
+			return std::clamp(j, -(jmax - 1), jmax - 1);
+		}
+	public:
+		// Tree on [0, T] with n steps reproducing discounts D(i dt).
+		hull_white(const curve::base<T, F>& f, F a, F σ, T T_, size_t n)
+			: dt(T_ / n), a(a), σ(σ)
+		{
+			ensure(n > 0 && T_ > 0 && a > 0 && σ > 0);
+
+			const F M = std::exp(-a * dt) - 1; // E[dx] = x M
+			const F V = σ * σ * (1 - std::exp(-2 * a * dt)) / (2 * a);
+			dx = std::sqrt(3 * V);
+			jmax = std::max<size_t>(1, static_cast<size_t>(std::ceil(F(0.184) / (a * dt))));
+			const long J = static_cast<long>(jmax);
+
+			qx.resize(2 * jmax + 1);
+			p.resize(2 * jmax + 1);
+			for (long j = -J; j <= J; ++j) {
+				qx[j + J] = std::exp(-j * dx * dt);
+				const F η = j * (1 + M) - middle(j, J); // mean offset from middle child in units of dx
+				p[j + J] = { F(1) / 6 + (η * η - η) / 2, F(2) / 3 - η * η, F(1) / 6 + (η * η + η) / 2 };
+			}
+
+			// Arrow-Debreu prices
+			e.resize(n);
+			std::vector<F> Q(2 * jmax + 1, F(0)), Q_(Q.size());
+			Q[J] = 1;
+			for (size_t i = 0; i < n; ++i) {
+				const long w = static_cast<long>(width(i));
+				F s = 0;
+				for (long j = -w; j <= w; ++j) {
+					s += Q[j + J] * qx[j + J];
+				}
+				e[i] = f.discount(dt * (i + 1)) / s;
+
+				std::fill(Q_.begin(), Q_.end(), F(0));
+				for (long j = -w; j <= w; ++j) {
+					const F x = Q[j + J] * e[i] * qx[j + J];
+					const long k = middle(j, J) + J;
+					Q_[k - 1] += x * p[j + J][0];
+					Q_[k] += x * p[j + J][1];
+					Q_[k + 1] += x * p[j + J][2];
+				}
+				std::swap(Q, Q_);
+			}
+		}
+
+		size_t steps() const
+		{
+			return e.size();
+		}
+		T step() const
+		{
+			return dt;
+		}
+		T time(size_t i) const
+		{
+			return dt * i;
+		}
+		size_t index(T u) const
+		{
+			return static_cast<size_t>(std::llround(u / dt));
+		}
+		F mean_reversion() const
+		{
+			return a;
+		}
+		F volatility() const
+		{
+			return σ;
+		}
+		size_t size(size_t i) const
+		{
+			return 2 * width(i) + 1;
+		}
+		size_t nodes() const
+		{
+			return 2 * jmax + 1;
+		}
+		// Short rate at node k of step i, j = k - width(i).
+		F rate(size_t i, size_t k) const
+		{
+			return -std::log(e[i]) / dt + (F(k) - F(width(i))) * dx;
+		}
+		F discount(size_t i, size_t k) const
+		{
+			return e[i] * qx[k - width(i) + jmax];
+		}
+
+		template<size_t K>
+		void roll(size_t i, const std::array<F, K>* v, std::array<F, K>* w, const std::array<F, K>& g) const
+		{
+			const long J = static_cast<long>(jmax);
+			const long w0 = static_cast<long>(width(i));
+			const long w1 = static_cast<long>(width(i + 1));
+			for (long j = -w0; j <= w0; ++j) {
+				const F d = e[i] * qx[j + J];
+				const auto& pj = p[j + J];
+				const std::array<F, K>* c = v + middle(j, J) + w1;
+				for (size_t k = 0; k < K; ++k) {
+					w[j + w0][k] = d * g[k] * (pj[0] * c[-1][k] + pj[1] * c[0][k] + pj[2] * c[1][k]);
+				}
+			}
+		}
+	};
+
+	// Built trees shared by every bond with the same inputs.
+	// Keyed by mean reversion, volatility, curve version and time grid.
+	template<class T = double, class F = double>
+	class cache {
+		using tree = hull_white<T, F>;
+		struct key {
+			F a, σ;
+			uint64_t version;
+			T T_;
+			size_t n;
+
+			bool operator<(const key& k) const
+			{
+				return std::tie(a, σ, version, T_, n) < std::tie(k.a, k.σ, k.version, k.T_, k.n);
+			}
+		};
+		using slot = std::shared_future<std::shared_ptr<const tree>>;
+		mutable std::mutex m;
+		std::map<key, slot> trees;
+		size_t builds = 0;
+	public:
+		// Tree for curve f published with version. Built at most once per key unless evicted.
+		// The lock only guards the map. The first request for a key builds outside it and
+		// concurrent requests for the same key wait on its slot.
+		std::shared_ptr<const tree> get(const curve::base<T, F>& f, uint64_t version, F a, F σ, T T_, size_t n)
+		{
+			const key k{ a, σ, version, T_, n };
+			std::promise<std::shared_ptr<const tree>> p;
+			slot s;
+			{
+				std::lock_guard lock(m);
+				auto i = trees.find(k);
+				if (i != trees.end()) {
+					s = i->second;
+				}
+				else {
+					trees.emplace(k, p.get_future().share());
+					++builds;
+				}
+			}
+			if (s.valid()) {
+				return s.get();
+			}
+
+			try {
+				auto t = std::make_shared<const tree>(f, a, σ, T_, n);
+				p.set_value(t);
+
+				return t;
+			}
+			catch (...) {
+				p.set_exception(std::current_exception());
+				std::lock_guard lock(m);
+				trees.erase(k); // let a later request retry
+
+				throw;
+			}
+		}
+		std::shared_ptr<const tree> get(const typename curve::handle<T, F>::snapshot& f, F a, F σ, T T_, size_t n)
+		{
+			ensure(f);
+
+			return get(*f, f.version, a, σ, T_, n);
+		}
+
+		// Drop trees built from curves older than version. Trees in use stay alive.
+		void evict(uint64_t version)
+		{
+			std::lock_guard lock(m);
+			std::erase_if(trees, [version](const auto& kv) { return kv.first.version < version; });
+		}
+
+		size_t size() const
+		{
+			std::lock_guard lock(m);
+			return trees.size();
+		}
+		// Number of trees built.
+		size_t built() const
+		{
+			std::lock_guard lock(m);
+			return builds;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int hull_white_test()
+	{
+		curve::handle<> h;
+		h.emplace<curve::constant<>>(0.04);
+		const double a = 0.1, σ = 0.01;
+		const size_t n = 240;
+
+		cache<> c;
+		const auto t = c.get(h.get(), a, σ, 10., n);
+		assert(t == c.get(h.get(), a, σ, 10., n));
+		assert(1 == c.built());
+		assert(t != c.get(h.get(), a, σ, 10., n / 2));
+		assert(2 == c.built());
+		{
+			// concurrent requests build each new key once
+			std::vector<std::shared_ptr<const hull_white<>>> x(8);
+			std::vector<std::thread> ts;
+			for (size_t i = 0; i < x.size(); ++i) {
+				ts.emplace_back([&, i] { x[i] = c.get(h.get(), a, σ, 10., n / 6 * (1 + i % 2)); });
+			}
+			for (auto& ti : ts) {
+				ti.join();
+			}
+			assert(4 == c.built());
+			for (size_t i = 2; i < x.size(); ++i) {
+				assert(x[i] == x[i % 2]);
+			}
+			assert(x[1] == c.get(h.get(), a, σ, 10., n / 3));
+			assert(4 == c.built());
+		}
+
+		// reprices zeros
+		for (size_t i = 1; i <= n; i += 17) {
+			std::vector<std::array<double, 1>> v(t->nodes(), { 0 });
+			const auto x = backward<1>(*t, v, { 0. }, [i, &t](size_t k, std::array<double, 1>* v) {
+				if (k == i) {
+					for (size_t j = 0; j < t->size(i); ++j) {
+						v[j][0] = 1;
+					}
+				}
+			});
+			assert(math::fabs(x[0] - std::exp(-0.04 * t->time(i))) < 1e-12);
+		}
+
+		std::vector<double> u(20), cf(20, 0.025);
+		for (size_t j = 0; j < 20; ++j) {
+			u[j] = 0.5 * (j + 1);
+		}
+		cf.back() += 1;
+		const double tc[] = { 5, 6, 7, 8, 9 };
+		const double pc[] = { 1, 1, 1, 1, 1 };
+		const auto b = callable(*t, 20, u.data(), cf.data(), 0, tc, pc);
+		const auto x = callable(*t, 20, u.data(), cf.data(), 5, tc, pc);
+		assert(x.value < b.value);
+		assert(x.duration() < b.duration());
+
+		// mean reversion lowers the value of the call relative to Ho-Lee
+		const ho_lee<> hl(*h.get(), σ, 10., n);
+		const auto y = callable(hl, 20, u.data(), cf.data(), 5, tc, pc);
+		assert(b.value - x.value < b.value - y.value);
+
+		// new curve version builds a new tree, old ones can be evicted
+		const uint64_t v = h.emplace<curve::constant<>>(0.05);
+		const auto t2 = c.get(h.get(), a, σ, 10., n);
+		assert(t2 != t && 5 == c.built());
+		c.evict(v);
+		assert(1 == c.size());
+		assert(t->steps() == n); // still alive
+
+		return 0;
+	}
+
+	inline int ho_lee_test()
+	{
+		const curve::constant<> f(0.04);
+		const double σ = 0.01;
+		const size_t n = 200;
+		const ho_lee<> t(f, σ, 10., n);
+		assert(n == t.steps());
+		assert(80 == t.index(4));
+
+		// 10 year 5% semiannual bond
+		std::vector<double> u(20), c(20, 0.025);
+		for (size_t j = 0; j < 20; ++j) {
+			u[j] = 0.5 * (j + 1);
+		}
+		c.back() += 1;
+
+		{
+			// bullet reprices the curve and shifted valuations equal recalibrated trees
+			const auto x = callable(t, 20, u.data(), c.data(), 0, u.data(), c.data(), 0.0001);
+			double p = 0, d = 0, cv = 0;
+			for (size_t j = 0; j < 20; ++j) {
+				const double D = f.discount(u[j]);
+				p += c[j] * D;
+				d += u[j] * c[j] * D;
+				cv += u[j] * u[j] * c[j] * D;
+			}
+			assert(math::fabs(x.value - p) < 1e-12);
+			assert(math::fabs(x.duration() - d / p) < 1e-5); // O(h^2)
+			assert(math::fabs(x.convexity() - cv / p) < 1e-3);
+
+			const curve::plus<> fu(f, 0.0001), fd(f, -0.0001);
+			const ho_lee<> tu(fu, σ, 10., n), td(fd, σ, 10., n);
+			const auto xu = callable(tu, 20, u.data(), c.data(), 0, u.data(), c.data());
+			const auto xd = callable(td, 20, u.data(), c.data(), 0, u.data(), c.data());
+			assert(math::fabs(x.up - xu.value) < 1e-12);
+			assert(math::fabs(x.down - xd.value) < 1e-12);
+		}
+		{
+			// callable at par on coupon dates from year 5
+			const double tc[] = { 5, 6, 7, 8, 9 };
+			const double pc[] = { 1, 1, 1, 1, 1 };
+			const auto b = callable(t, 20, u.data(), c.data(), 0, tc, pc);
+			const auto x = callable(t, 20, u.data(), c.data(), 5, tc, pc);
+			assert(x.value < b.value);
+			assert(x.duration() < b.duration());
+			assert(x.convexity() < b.convexity());
+
+			const curve::plus<> fu(f, 0.0001), fd(f, -0.0001);
+			const ho_lee<> tu(fu, σ, 10., n), td(fd, σ, 10., n);
+			assert(math::fabs(x.up - callable(tu, 20, u.data(), c.data(), 5, tc, pc).value) < 1e-12);
+			assert(math::fabs(x.down - callable(td, 20, u.data(), c.data(), 5, tc, pc).value) < 1e-12);
+		}
+
+		return 0;
+	}
+
+	inline int oas_test()
+	{
+		const curve::constant<> f(0.04);
+		const double σ = 0.01;
+		const size_t n = 200;
+		const ho_lee<> t(f, σ, 10., n);
+
+		std::vector<double> u(20), c(20, 0.025);
+		for (size_t j = 0; j < 20; ++j) {
+			u[j] = 0.5 * (j + 1);
+		}
+		c.back() += 1;
+		const double tc[] = { 5, 6, 7, 8, 9 };
+		const double pc[] = { 1, 1, 1, 1, 1 };
+		const schedule<> sc(t, 20, u.data(), c.data(), 5, tc, pc);
+
+		// zero spread is the tree value
+		const auto x0 = callable(t, 20, u.data(), c.data(), 5, tc, pc, 0.0123);
+		const auto v0 = spread(t, sc, 0.);
+		assert(math::fabs(v0[0] - x0.value) < 1e-14);
+		// spread is a parallel shift of the short rates
+		const auto v1 = spread(t, sc, 0.0123);
+		assert(math::fabs(v1[0] - x0.up) < 1e-14);
+
+		// derivative from the same pass
+		const double h = 1e-6;
+		const double dv = (spread(t, sc, 0.0123 + h)[0] - spread(t, sc, 0.0123 - h)[0]) / (2 * h);
+		assert(math::fabs(v1[1] - dv) < 1e-6);
+
+		// recover the spread from the price without rebuilding the tree
+		const auto x = oas(t, sc, v1[0]);
+		assert(x.converged);
+		assert(math::fabs(x.spread - 0.0123) < 1e-12);
+		assert(x.iter <= 6);
+		assert(math::fabs(x.value - v1[0]) < 1e-12);
+		const auto y = oas(t, 20, u.data(), c.data(), 5, tc, pc, 0.95);
+		assert(math::fabs(spread(t, sc, y.spread)[0] - 0.95) < 1e-12);
+		assert(y.converged && y.spread > 0);
+		// too few iterations is reported
+		const auto w = oas(t, sc, 0.95, 0., 1e-12, 2);
+		assert(!w.converged && 2 == w.iter);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::lattice
@@ -0,0 +1,168 @@
+// tmx_make_whole.h - Bonds with a make-whole call.
+// From the first call date t0 the issuer may redeem after any coupon date t
+// for the greater of par p and the remaining flows discounted at treasury
+// plus spread s:
+//   K(t) = max(p, sum_{u_j > t} c_j D_tsy(t, u_j) exp(-s (u_j - t)))
+// The issuer calls when K(t) is below the value of holding on the valuation
+// curve, H(t) = sum_{u_j > t} c_j D(t, u_j). The bond is worth
+//   H(0) - max(0, max_t D(t) (H(t) - K(t)))
+// Both legs are accumulated in one backward walk over the flows.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "tmx_curve.h"
+#include "tmx_parallel.h"
+
+namespace tmx::make_whole {
+
+	template<class T = double, class F = double>
+	struct result {
+		F value; // with the call
+		F hold;  // without the call
+		T call;  // optimal call date or NaN if never called
+	};
+
+	// Walk flows backward. D(t) returns the pair D(t), D_tsy(t) exp(-s t) and is called once per flow.
+	template<class U, class C, class T, class F, class Discount>
+	inline result<T, F> walk(size_t m, const U* u, const C* c, T t0, F p, const Discount& D)
+	{
+		result<T, F> r{ F(0), F(0), math::NaN<T> };
+		F H = 0, G = 0, gain = 0; // hold leg, call leg, best call gain
+		for (size_t j = m; j-- > 0; ) {
+			const auto [Df, Dg] = D(u[j]);
+			if (j + 1 < m && u[j] >= t0) {
+				// call after the coupon paid at u[j]
+				const F K = std::max(p * Df, G * Df / Dg); // at time 0
+				if (H - K > gain) {
+					gain = H - K;
+					r.call = u[j];
+				}
+			}
+			H += c[j] * Df;
+			G += c[j] * Dg;
+		}
+		r.hold = H;
+		r.value = H - gain;
+
+		return r;
+	}
+
+	// Bond with flows c[j] at u[j] valued on f, make-whole at tsy plus s from t0 with par p.
+	template<class U, class C, class T, class F>
+	inline result<T, F> value(size_t m, const U* u, const C* c, const curve::base<T, F>& f,
+		const curve::base<T, F>& tsy, F s, T t0, F p = 1)
+	{
+		return walk(m, u, c, t0, p, [&](T t) {
+			return std::pair<F, F>(f.discount(t), tsy.discount(t) * std::exp(-s * t));
+		});
+	}
+
+	// Book of n bonds, bond i has flows u[o[i]..o[i + 1]), c[o[i]..o[i + 1]), spread s[i], first call t0[i], par p[i].
+	// Valuation and treasury discounts are computed once per distinct date over the whole book.
+	template<class U, class C, class T, class F>
+	inline void value(size_t n, const size_t* o, const U* u, const C* c, const curve::base<T, F>& f,
+		const curve::base<T, F>& tsy, const F* s, const T* t0, const F* p, result<T, F>* r,
+		unsigned threads = parallel::concurrency())
+	{
+		std::vector<T> x(u, u + o[n]);
+		std::sort(x.begin(), x.end());
+		x.erase(std::unique(x.begin(), x.end()), x.end());
+		std::vector<F> Df(x.size()), Dt(x.size());
+		parallel::for_each(x.size(), [&](size_t i) {
+			Df[i] = f.discount(x[i]);
+			Dt[i] = tsy.discount(x[i]);
+		}, threads, 256);
+
+		parallel::for_each(n, [&](size_t i) {
+			const F si = s[i];
+			r[i] = walk(o[i + 1] - o[i], u + o[i], c + o[i], t0[i], p[i], [&](T t) {
+				const size_t k = std::lower_bound(x.begin(), x.end(), t) - x.begin();
+				return std::pair<F, F>(Df[k], Dt[k] * std::exp(-si * t));
+			});
+		}, threads, 64);
+	}
+
+#ifdef _DEBUG
+	inline int value_test()
+	{
+		const curve::constant<> f(0.05), tsy(0.04);
+
+		// 10 year 6% semiannual
+		std::vector<double> u(20), c(20, 0.03);
+		for (size_t j = 0; j < 20; ++j) {
+			u[j] = 0.5 * (j + 1);
+		}
+		c.back() += 1;
+
+		// brute force over call dates
+		const auto brute = [&](double s, double t0, double p) {
+			double hold = 0;
+			for (size_t j = 0; j < 20; ++j) {
+				hold += c[j] * f.discount(u[j]);
+			}
+			double v = hold;
+			for (size_t k = 0; k + 1 < 20; ++k) {
+				if (u[k] < t0) {
+					continue;
+				}
+				double before = 0, G = 0;
+				for (size_t j = 0; j <= k; ++j) {
+					before += c[j] * f.discount(u[j]);
+				}
+				for (size_t j = k + 1; j < 20; ++j) {
+					G += c[j] * tsy.discount(u[j], u[k]) * std::exp(-s * (u[j] - u[k]));
+				}
+				v = std::min(v, before + f.discount(u[k]) * std::max(p, G));
+			}
+			return v;
+		};
+
+		{
+			// treasury plus spread above the valuation curve would call at par
+			const auto r = value(20, u.data(), c.data(), f, tsy, 0.05, 0., 1.);
+			assert(r.value < r.hold);
+			assert(!std::isnan(r.call));
+			assert(math::fabs(r.value - brute(0.05, 0, 1)) < 1e-12);
+		}
+		{
+			// tight make-whole spread is never exercised
+			const auto r = value(20, u.data(), c.data(), f, tsy, 0.005, 0., 1.);
+			assert(r.value == r.hold);
+			assert(std::isnan(r.call));
+			assert(math::fabs(r.value - brute(0.005, 0, 1)) < 1e-12);
+		}
+		{
+			// book
+			const size_t n = 100;
+			std::vector<size_t> o(n + 1, 0);
+			std::vector<double> ub, cb, s(n), t0(n), p(n);
+			for (size_t i = 0; i < n; ++i) {
+				const size_t m = 2 * (1 + i % 20);
+				for (size_t j = 0; j < m; ++j) {
+					ub.push_back(0.5 * (j + 1));
+					cb.push_back(0.005 * (1 + i % 9) + (j + 1 == m));
+				}
+				o[i + 1] = o[i] + m;
+				s[i] = 0.0025 * (i % 25);
+				t0[i] = 0.5 * (i % 5);
+				p[i] = 1;
+			}
+			std::vector<result<>> r(n);
+			value(n, o.data(), ub.data(), cb.data(), f, tsy, s.data(), t0.data(), p.data(), r.data(), 3);
+			for (size_t i = 0; i < n; ++i) {
+				const auto x = value(o[i + 1] - o[i], ub.data() + o[i], cb.data() + o[i], f, tsy, s[i], t0[i], p[i]);
+				assert(math::fabs(r[i].value - x.value) < 1e-12);
+				assert(r[i].value <= r[i].hold);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::make_whole
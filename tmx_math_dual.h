@@ -0,0 +1,212 @@
+// tmx_math_dual.h - Dual numbers for forward mode derivatives.
+// dual<X, N> carries a value and its gradient with respect to N inputs.
+// Functions templated on the number type give analytic Jacobians when
+// called with duals seeded by variable(x, i).
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <array>
+#include <cmath>
+#include <type_traits>
+#include "tmx_math.h"
+
+namespace tmx::math {
+
+	template<class X = double, size_t N = 1>
+	struct dual {
+		X x;
+		std::array<X, N> d;
+
+		constexpr dual(X x = 0)
+			: x(x), d{}
+		{ }
+		// i-th independent variable
+		static constexpr dual variable(X x, size_t i)
+		{
+			dual v(x);
+			v.d[i] = 1;
+
+			return v;
+		}
+
+		dual& operator+=(const dual& y)
+		{
+			x += y.x;
+			for (size_t i = 0; i < N; ++i) {
+				d[i] += y.d[i];
+			}
+			return *this;
+		}
+		dual& operator-=(const dual& y)
+		{
+			x -= y.x;
+			for (size_t i = 0; i < N; ++i) {
+				d[i] -= y.d[i];
+			}
+			return *this;
+		}
+		dual& operator*=(const dual& y)
+		{
+			for (size_t i = 0; i < N; ++i) {
+				d[i] = d[i] * y.x + x * y.d[i];
+			}
+			x *= y.x;
+			return *this;
+		}
+		dual& operator/=(const dual& y)
+		{
+			x /= y.x;
+			for (size_t i = 0; i < N; ++i) {
+				d[i] = (d[i] - x * y.d[i]) / y.x;
+			}
+			return *this;
+		}
+		dual operator-() const
+		{
+			dual y(*this);
+			y.x = -x;
+			for (size_t i = 0; i < N; ++i) {
+				y.d[i] = -d[i];
+			}
+			return y;
+		}
+	};
+
+	template<class X, size_t N>
+	inline dual<X, N> operator+(dual<X, N> a, const dual<X, N>& b)
+	{
+		return a += b;
+	}
+	template<class X, size_t N>
+	inline dual<X, N> operator-(dual<X, N> a, const dual<X, N>& b)
+	{
+		return a -= b;
+	}
+	template<class X, size_t N>
+	inline dual<X, N> operator*(dual<X, N> a, const dual<X, N>& b)
+	{
+		return a *= b;
+	}
+	template<class X, size_t N>
+	inline dual<X, N> operator/(dual<X, N> a, const dual<X, N>& b)
+	{
+		return a /= b;
+	}
+	// mixed with scalars
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator+(dual<X, N> a, S b)
+	{
+		a.x += X(b);
+		return a;
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator+(S a, dual<X, N> b)
+	{
+		return b + a;
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator-(dual<X, N> a, S b)
+	{
+		a.x -= X(b);
+		return a;
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator-(S a, const dual<X, N>& b)
+	{
+		return -b + a;
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator*(dual<X, N> a, S b)
+	{
+		a.x *= X(b);
+		for (auto& di : a.d) {
+			di *= X(b);
+		}
+		return a;
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator*(S a, const dual<X, N>& b)
+	{
+		return b * a;
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator/(const dual<X, N>& a, S b)
+	{
+		return a * (1 / X(b));
+	}
+	template<class X, size_t N, class S> requires std::is_arithmetic_v<S>
+	inline dual<X, N> operator/(S a, const dual<X, N>& b)
+	{
+		return dual<X, N>(X(a)) / b;
+	}
+
+	// Apply f with f(x) = y and f'(x) = dy.
+	template<class X, size_t N>
+	inline dual<X, N> chain(const dual<X, N>& a, X y, X dy)
+	{
+		dual<X, N> b(y);
+		for (size_t i = 0; i < N; ++i) {
+			b.d[i] = dy * a.d[i];
+		}
+		return b;
+	}
+	template<class X, size_t N>
+	inline dual<X, N> exp(const dual<X, N>& a)
+	{
+		const X y = std::exp(a.x);
+		return chain(a, y, y);
+	}
+	template<class X, size_t N>
+	inline dual<X, N> log(const dual<X, N>& a)
+	{
+		return chain(a, std::log(a.x), 1 / a.x);
+	}
+	template<class X, size_t N>
+	inline dual<X, N> sqrt(const dual<X, N>& a)
+	{
+		const X y = std::sqrt(a.x);
+		return chain(a, y, 1 / (2 * y));
+	}
+	template<class X, size_t N>
+	inline dual<X, N> pow(const dual<X, N>& a, X p)
+	{
+		const X y = std::pow(a.x, p);
+		return chain(a, y, p * y / a.x);
+	}
+
+	// Value part of a number.
+	template<class X>
+	inline X real(X x)
+	{
+		return x;
+	}
+	template<class X, size_t N>
+	inline X real(const dual<X, N>& a)
+	{
+		return a.x;
+	}
+
+#ifdef _DEBUG
+	inline int dual_test()
+	{
+		using D = dual<double, 2>;
+		const D x = D::variable(2., 0), y = D::variable(3., 1);
+		{
+			const D z = x * y + x / y - 1. + 2. * x;
+			assert(z.x == 2 * 3 + 2. / 3 - 1 + 4);
+			assert(math::fabs(z.d[0] - (3 + 1. / 3 + 2)) < 1e-15);
+			assert(math::fabs(z.d[1] - (2 - 2. / 9)) < 1e-15);
+		}
+		{
+			const D z = exp(x) * log(y) + sqrt(x) - pow(y, 1.5);
+			assert(math::fabs(z.d[0] - (std::exp(2.) * std::log(3.) + 0.5 / std::sqrt(2.))) < 1e-14);
+			assert(math::fabs(z.d[1] - (std::exp(2.) / 3 - 1.5 * std::sqrt(3.))) < 1e-14);
+			assert(real(z) == z.x && real(1.5) == 1.5);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::math
@@ -0,0 +1,308 @@
+// tmx_mbs.h - Mortgage pass-through pools.
+// A pool with balance B, gross rate w and remaining term N months pays the level
+// scheduled payment B i/(1 - (1 + i)^{-N}), i = w/12, and its holders receive
+// the net coupon on B plus scheduled principal plus prepayments. The single
+// monthly mortality smm = 1 - (1 - cpr)^{1/12} is applied to the balance after
+// scheduled principal. Pools are stored as structure of arrays and projected
+// month by month with each month a branch free loop over a block of pools.
+// smm is tabulated once per distinct speed and loan age. Month t pays at
+// (t + 1)/12 so all pools share one discount grid.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "ensure.h"
+#include "tmx_math.h"
+#include "tmx_curve_pwflat.h"
+#include "tmx_parallel.h"
+
+namespace tmx::mbs {
+
+	// CPR for loan age months 1..n at 100 PSA: 0.2% per month rising to 6% at month 30.
+	template<class F = double>
+	inline std::vector<F> psa(size_t n = 360)
+	{
+		std::vector<F> cpr(n);
+		for (size_t a = 0; a < n; ++a) {
+			cpr[a] = F(0.002) * std::min<size_t>(a + 1, 30);
+		}
+
+		return cpr;
+	}
+
+	// Pools as structure of arrays.
+	template<class F = double>
+	struct pools {
+		std::vector<F> balance;
+		std::vector<F> wac;      // gross mortgage rate
+		std::vector<F> coupon;   // net pass-through rate
+		std::vector<unsigned> term, age; // remaining and elapsed months
+		std::vector<F> speed;    // multiple of the prepayment vector, 1 = 100 PSA
+
+		size_t size() const
+		{
+			return balance.size();
+		}
+		// Largest remaining term.
+		unsigned months() const
+		{
+			return term.empty() ? 0 : *std::max_element(term.begin(), term.end());
+		}
+
+		pools& push_back(F B, F w, F c, unsigned N, unsigned a = 0, F s = 1)
+		{
+			ensure(N > 0);
+
+			balance.push_back(B);
+			wac.push_back(w);
+			coupon.push_back(c);
+			term.push_back(N);
+			age.push_back(a);
+			speed.push_back(s);
+
+			return *this;
+		}
+	};
+
+	// Single monthly mortality by speed and loan age computed once for the distinct speeds
+	// of a pool set: smm[j nc + a] = 1 - (1 - min(1, speed[j] cpr[a]))^{1/12}.
+	template<class F = double>
+	struct mortality {
+		size_t nc;
+		std::vector<F> speed; // distinct speeds, increasing
+		std::vector<F> smm;
+
+		mortality(const pools<F>& p, size_t nc, const F* cpr)
+			: nc(nc), speed(p.speed)
+		{
+			ensure(nc > 0);
+
+			std::sort(speed.begin(), speed.end());
+			speed.erase(std::unique(speed.begin(), speed.end()), speed.end());
+			smm.resize(speed.size() * nc);
+			for (size_t j = 0; j < speed.size(); ++j) {
+				for (size_t a = 0; a < nc; ++a) {
+					const F r = std::min(F(1), speed[j] * cpr[a]);
+					smm[j * nc + a] = 1 - std::pow(1 - r, F(1) / 12);
+				}
+			}
+		}
+
+		// Offset of the row for speed s.
+		size_t row(F s) const
+		{
+			return (std::lower_bound(speed.begin(), speed.end(), s) - speed.begin()) * nc;
+		}
+	};
+
+	// Pools per block sharing month loops.
+	inline constexpr size_t block = 256;
+
+	// Project pools [b, e) for months t < M month major into x[t (e - b) + k], zero from term[b + k] on.
+	// CPR of pool i in month t is min(1, speed[i] cpr[min(age[i] + t, nc - 1)]). Each month gathers
+	// the smm of every pool from the mortality table and then runs a branch free loop over the block.
+	template<class F>
+	inline void project(const pools<F>& p, size_t b, size_t e, const mortality<F>& q, size_t M, F* x)
+	{
+		const size_t n = e - b;
+		std::vector<F> B(n), i(n), A(n), c(n), N(n), g(n);
+		std::vector<size_t> o(n), l(n); // smm of month t at min(o + t, l)
+		for (size_t k = 0; k < n; ++k) {
+			B[k] = p.balance[b + k];
+			i[k] = p.wac[b + k] / 12;
+			// annuity factor sum_{j = 1}^{N - t} (1 + i)^{-j}, A_{t + 1} = A_t (1 + i) - 1
+			A[k] = i[k] > 0 ? (1 - std::pow(1 + i[k], -F(p.term[b + k]))) / i[k] : F(p.term[b + k]);
+			c[k] = p.coupon[b + k] / 12;
+			N[k] = F(p.term[b + k]);
+			const size_t r = q.row(p.speed[b + k]);
+			o[k] = r + p.age[b + k];
+			l[k] = r + q.nc - 1;
+		}
+
+		const F* smm = q.smm.data();
+		for (size_t t = 0; t < M; ++t) {
+			F* xt = x + t * n;
+			const F t_ = F(t);
+			// gather in its own loop so the projection loop has no indirect loads
+			for (size_t k = 0; k < n; ++k) {
+				g[k] = smm[std::min(o[k] + t, l[k])];
+			}
+			for (size_t k = 0; k < n; ++k) {
+				// masks instead of selects so the division is never moved under a branch
+				const F live = t_ < N[k], next = t_ + 1 < N[k];
+				const F S = B[k] / A[k] - B[k] * i[k];
+				const F R = g[k] * (B[k] - S);
+				xt[k] = live * (B[k] * c[k] + S + R);
+				// paid off pools stay at B = 0, A = 1
+				B[k] = next * (B[k] - (S + R));
+				A[k] = next * (A[k] * (1 + i[k]) - 1) + (1 - next);
+			}
+		}
+	}
+
+	// Cash flows of all pools at times (t + 1)/12, t < M, with pool i in c[i M .. (i + 1) M).
+	// Each pool is the instrument with m = M, u = times and c + i M.
+	// Blocks are projected month major and transposed once into c.
+	template<class F>
+	inline void cash_flows(const pools<F>& p, size_t M, F* c, size_t nc, const F* cpr,
+		unsigned threads = parallel::concurrency())
+	{
+		const mortality<F> q(p, nc, cpr);
+
+		parallel::for_chunks((p.size() + block - 1) / block, [&](size_t, size_t b, size_t e) {
+			std::vector<F> x;
+			for (size_t j = b; j < e; ++j) {
+				const size_t b_ = j * block, e_ = std::min(p.size(), (j + 1) * block);
+				const size_t n = e_ - b_;
+				x.resize(M * n);
+				project(p, b_, e_, q, M, x.data());
+				for (size_t k = 0; k < n; ++k) {
+					F* ck = c + (b_ + k) * M;
+					for (size_t t = 0; t < M; ++t) {
+						ck[t] = x[t * n + k];
+					}
+				}
+			}
+		}, threads);
+	}
+	template<class F>
+	inline void cash_flows(const pools<F>& p, size_t M, F* c, unsigned threads = parallel::concurrency())
+	{
+		const auto cpr = psa<F>();
+
+		cash_flows(p, M, c, cpr.size(), cpr.data(), threads);
+	}
+
+	// Present value v[i] of each pool on f. Discounts of the monthly grid come from one curve walk.
+	template<class T, class F>
+	inline void value(const pools<F>& p, const curve::pwflat<T, F>& f, F* v, size_t nc, const F* cpr,
+		unsigned threads = parallel::concurrency())
+	{
+		const unsigned M = p.months();
+		std::vector<T> u(M);
+		for (unsigned t = 0; t < M; ++t) {
+			u[t] = T(t + 1) / 12;
+		}
+		std::vector<F> D(M);
+		f.discount(M, u.data(), D.data());
+		const mortality<F> q(p, nc, cpr);
+
+		parallel::for_chunks((p.size() + block - 1) / block, [&](size_t, size_t b, size_t e) {
+			std::vector<F> x;
+			for (size_t j = b; j < e; ++j) {
+				const size_t b_ = j * block, e_ = std::min(p.size(), (j + 1) * block);
+				const size_t n = e_ - b_;
+				unsigned M_ = 0;
+				for (size_t k = b_; k < e_; ++k) {
+					M_ = std::max(M_, p.term[k]);
+				}
+				x.resize(M_ * n);
+				project(p, b_, e_, q, M_, x.data());
+				F* vj = v + b_;
+				std::fill(vj, vj + n, F(0));
+				for (size_t t = 0; t < M_; ++t) {
+					const F* xt = x.data() + t * n;
+					for (size_t k = 0; k < n; ++k) {
+						vj[k] += xt[k] * D[t];
+					}
+				}
+			}
+		}, threads);
+	}
+	template<class T, class F>
+	inline void value(const pools<F>& p, const curve::pwflat<T, F>& f, F* v, unsigned threads = parallel::concurrency())
+	{
+		const auto cpr = psa<F>();
+
+		value(p, f, v, cpr.size(), cpr.data(), threads);
+	}
+
+#ifdef _DEBUG
+	inline int value_test()
+	{
+		{
+			const auto cpr = psa<>();
+			assert(math::fabs(cpr[0] - 0.002) < 1e-15);
+			assert(math::fabs(cpr[29] - 0.06) < 1e-15);
+			assert(math::fabs(cpr[359] - 0.06) < 1e-15);
+		}
+		{
+			// no prepayment is a level payment mortgage
+			pools<> p;
+			p.push_back(100, 0.06, 0.06, 360, 0, 0);
+			std::vector<double> c(360);
+			cash_flows(p, 360, c.data(), 1);
+			const double i = 0.005, P = 100 * i / (1 - std::pow(1 + i, -360.));
+			for (size_t t = 0; t < 360; ++t) {
+				assert(math::fabs(c[t] - P) < 1e-10);
+			}
+			// discounted at the mortgage rate it is worth par
+			const double tk[] = { 1 };
+			const double fk[] = { 12 * std::log1p(i) };
+			const curve::pwflat<> f(1, tk, fk, fk[0]);
+			double v;
+			value(p, f, &v, 1);
+			assert(math::fabs(v - 100) < 1e-10);
+		}
+		{
+			// zero rate pays level principal and nothing after its term
+			pools<> p;
+			p.push_back(120, 0, 0, 12, 0, 0);
+			p.push_back(100, 0.06, 0.05, 24, 0, 0);
+			std::vector<double> c(2 * 24);
+			cash_flows(p, 24, c.data(), 1);
+			for (size_t t = 0; t < 24; ++t) {
+				assert(math::fabs(c[t] - (t < 12 ? 10 : 0)) < 1e-12);
+			}
+		}
+
+		// many pools with mixed terms, ages and speeds
+		const size_t n = 1000;
+		pools<> p;
+		for (size_t k = 0; k < n; ++k) {
+			p.push_back(1 + k % 7, 0.04 + 0.0001 * (k % 50), 0.035 + 0.0001 * (k % 50),
+				unsigned(60 + k % 300), unsigned(k % 40), 0.5 + 0.01 * (k % 200));
+		}
+		const size_t M = p.months();
+		const double tk[] = { 1, 5, 10, 30 };
+		const double fk[] = { 0.03, 0.035, 0.04, 0.045 };
+		const curve::pwflat<> f(4, tk, fk, 0.045);
+
+		std::vector<double> c(n * M), c1(n * M), v(n), v1(n);
+		cash_flows(p, M, c.data(), 4);
+		cash_flows(p, M, c1.data(), 1);
+		assert(c == c1);
+		value(p, f, v.data(), 4);
+		value(p, f, v1.data(), 1);
+		assert(v == v1);
+
+		const auto cpr = psa<>();
+		for (size_t k = 0; k < n; k += 37) {
+			// scalar projection
+			double B = p.balance[k], pv = 0;
+			const double i = p.wac[k] / 12;
+			for (unsigned t = 0; t < p.term[k]; ++t) {
+				const unsigned N = p.term[k] - t;
+				const double S = B * i / (1 - std::pow(1 + i, -double(N))) - B * i;
+				const double r = std::min(1., p.speed[k] * cpr[std::min<size_t>(p.age[k] + t, 359)]);
+				const double R = (1 - std::pow(1 - r, 1. / 12)) * (B - S);
+				const double x = B * p.coupon[k] / 12 + S + R;
+				assert(math::fabs(c[k * M + t] - x) < 1e-12);
+				pv += x * f.discount((t + 1) / 12.);
+				B -= S + R;
+			}
+			assert(math::fabs(B) < 1e-10);
+			assert(math::fabs(v[k] - pv) < 1e-12);
+			for (size_t t = p.term[k]; t < M; ++t) {
+				assert(c[k * M + t] == 0);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::mbs
@@ -80,6 +80,25 @@ namespace tmx::option {
 			return k * v.pdf(x);
 		}
 
+		// Batch v[i] = value(f[i], s[i], k[i]) for the normal variate.
+		// The first loop has no branches so it vectorizes; degenerate inputs are fixed up after.
+		template<class F, class S, class K>
+		inline void value(size_t n, const F* f, const S* s, const K* k, F* v)
+		{
+			constexpr F sqrt1_2 = F(1) / std::numbers::sqrt2_v<F>;
+
+			for (size_t i = 0; i < n; ++i) {
+				const F s_ = std::max(F(s[i]), math::epsilon<F>);
+				const F x = (std::log(std::max(F(k[i]), F(1e-300)) / std::max(f[i], F(1e-300))) + s_ * s_ / 2) / s_;
+				v[i] = k[i] * std::erfc(-x * sqrt1_2) / 2 - f[i] * std::erfc(-(x - s_) * sqrt1_2) / 2;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				if (f[i] <= 0 or k[i] <= 0 or s[i] <= 0) {
+					v[i] = value(f[i], s[i], k[i]);
+				}
+			}
+		}
+
 		// Return Black implied vol s with p = value(f, s, k)
 		template<class F, class P, class K>
 		inline auto implied(F f, P p, K k, P s0 = 0.1,
@@ -116,6 +135,16 @@ namespace tmx::option {
 				assert(math::equal_precision(v, v_, -3));
 
 			}
+			{
+				double f[] = { 100, 100, 90, 0, 100 };
+				double s[] = { 0.1, 0.2, 0.3, 0.1, 0 };
+				double k[] = { 100, 110, 100, 100, 90 };
+				double v[5];
+				value(5, f, s, k, v);
+				for (size_t i = 0; i < 5; ++i) {
+					assert(math::equal_precision(v[i], value(f[i], s[i], k[i]), -12));
+				}
+			}
 
 			return 0;
 		}
@@ -149,10 +178,20 @@ namespace tmx::option {
 			return put::vega(f, s, k, v);
 		}
 
+		// Batch put values plus f - k by put-call parity.
+		template<class F, class S, class K>
+		inline void value(size_t n, const F* f, const S* s, const K* k, F* v)
+		{
+			put::value(n, f, s, k, v);
+			for (size_t i = 0; i < n; ++i) {
+				v[i] += f[i] - k[i];
+			}
+		}
+
 		// return s with c = call::value(f, s, k)
 		template<class F = double, class C = double, class K = double>
 		inline auto implied(F f, C c, K k, C s0 = 0.1,
-			double tol = root1d::sqrt_epsilon<C>, int iter = 100)
+			double tol = math::sqrt_epsilon<C>, int iter = 100)
 		{
 			return put::implied(f, c - f + k, k, s0);
 		}
@@ -0,0 +1,324 @@
+// tmx_option_bachelier.h - Bachelier (normal) model
+// F = f + s X where X is standard normal, so E[F] = f and Var(F) = s^2.
+// Unlike the Black model forwards and strikes may be zero or negative.
+// With d = (f - k)/s
+//   call = (f - k) N(d) + s n(d)
+//   put  = (k - f) N(-d) + s n(d)
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include "tmx_math.h"
+
+namespace tmx::option::bachelier {
+
+	template<class X>
+	inline X pdf(X x)
+	{
+		const X one_sqrt2pi = X(1) / std::sqrt(2 * std::numbers::pi_v<X>);
+
+		return std::exp(-x * x / 2) * one_sqrt2pi;
+	}
+	template<class X>
+	inline X cdf(X x)
+	{
+		return std::erfc(-x / std::numbers::sqrt2_v<X>) / 2;
+	}
+
+	// F <= k if and only if X <= (k - f)/s
+	template<class F, class S, class K>
+	inline F moneyness(F f, S s, K k)
+	{
+		if (s <= 0) {
+			return math::NaN<F>;
+		}
+
+		return (k - f) / s;
+	}
+
+	// Return s for an option with |f - k| = a and time value β using the rational approximation of
+	// Jäckel, Implied Normal Volatility (2017), and one Householder step.
+	// Return NaN if β < 0.
+	template<class F>
+	inline F implied(F a, F β)
+	{
+		if (β < 0) {
+			return math::NaN<F>;
+		}
+		if (β == 0) {
+			return F(0);
+		}
+		if (a == 0) {
+			return β * std::sqrt(2 * std::numbers::pi_v<F>);
+		}
+
+		// φ(x) = N(x) + n(x)/x for x = -|f - k|/s < 0
+		const auto φ = [](F x) { return cdf(x) + pdf(x) / x; };
+		const F φ_ = -β / a;
+		F x;
+		if (φ_ < F(-0.001882039271)) {
+			const F g = 1 / (φ_ - F(0.5));
+			const F g2 = g * g;
+			const F ξ = (F(0.032114372355) - g2 * (F(0.016969777977) - g2 * (F(2.6207332461e-3) - F(9.6066952861e-5) * g2)))
+			          / (1 - g2 * (F(0.6635646938) - g2 * (F(0.14528712196) - F(0.010472855461) * g2)));
+			x = g * (F(1) / std::sqrt(2 * std::numbers::pi_v<F>) + ξ * g2);
+		}
+		else {
+			const F h = std::sqrt(-std::log(-φ_));
+			x = (F(9.4883409779) - h * (F(9.6320903635) - h * (F(0.58556997323) + F(2.1464093351) * h)))
+			  / (1 - h * (F(0.65174820867) + h * (F(1.5120247828) + F(6.6437847132e-5) * h)));
+		}
+		const F q = (φ(x) - φ_) / pdf(x);
+		const F x2 = x * x;
+		x += 3 * q * x2 * (2 - q * x * (2 + x2))
+		   / (6 + q * x * (-12 + x * (6 * q + x * (-6 + q * x * (3 + x2)))));
+
+		return a / math::fabs(x);
+	}
+
+	namespace put {
+
+		template<class F, class S, class K>
+		inline F value(F f, S s, K k)
+		{
+			if (s <= 0) {
+				return std::max(k - f, F(0));
+			}
+
+			const F x = moneyness(f, s, k);
+
+			return (k - f) * cdf(x) + s * pdf(x);
+		}
+
+		template<class F, class S, class K>
+		inline F delta(F f, S s, K k)
+		{
+			if (s <= 0) {
+				return F(-1) * (f <= k);
+			}
+
+			return -cdf(moneyness(f, s, k));
+		}
+
+		template<class F, class S, class K>
+		inline F gamma(F f, S s, K k)
+		{
+			if (s <= 0) {
+				return f == k ? math::infinity<F> : F(0);
+			}
+
+			return pdf(moneyness(f, s, k)) / s;
+		}
+
+		// Derivative with respect to s.
+		template<class F, class S, class K>
+		inline F vega(F f, S s, K k)
+		{
+			if (s <= 0) {
+				return f == k ? pdf(F(0)) : F(0);
+			}
+
+			return pdf(moneyness(f, s, k));
+		}
+
+		// Batch v[i] = value(f[i], s[i], k[i]).
+		// The first loop has no branches so it vectorizes; degenerate inputs are fixed up after.
+		template<class F, class S, class K>
+		inline void value(size_t n, const F* f, const S* s, const K* k, F* v)
+		{
+			constexpr F sqrt1_2 = F(1) / std::numbers::sqrt2_v<F>;
+			const F one_sqrt2pi = F(1) / std::sqrt(2 * std::numbers::pi_v<F>);
+
+			for (size_t i = 0; i < n; ++i) {
+				const F s_ = std::max(F(s[i]), math::epsilon<F>);
+				const F x = (k[i] - f[i]) / s_;
+				v[i] = (k[i] - f[i]) * std::erfc(-x * sqrt1_2) / 2 + s_ * std::exp(-x * x / 2) * one_sqrt2pi;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				if (s[i] <= 0) {
+					v[i] = value(f[i], s[i], k[i]);
+				}
+			}
+		}
+
+		// Batch value, delta and vega in one pass.
+		template<class F, class S, class K>
+		inline void greeks(size_t n, const F* f, const S* s, const K* k, F* v, F* dv, F* vv)
+		{
+			constexpr F sqrt1_2 = F(1) / std::numbers::sqrt2_v<F>;
+			const F one_sqrt2pi = F(1) / std::sqrt(2 * std::numbers::pi_v<F>);
+
+			for (size_t i = 0; i < n; ++i) {
+				const F s_ = std::max(F(s[i]), math::epsilon<F>);
+				const F x = (k[i] - f[i]) / s_;
+				const F N = std::erfc(-x * sqrt1_2) / 2;
+				const F n_ = std::exp(-x * x / 2) * one_sqrt2pi;
+				v[i] = (k[i] - f[i]) * N + s_ * n_;
+				dv[i] = -N;
+				vv[i] = n_;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				if (s[i] <= 0) {
+					v[i] = value(f[i], s[i], k[i]);
+					dv[i] = delta(f[i], s[i], k[i]);
+					vv[i] = vega(f[i], s[i], k[i]);
+				}
+			}
+		}
+
+		// Return s with p = value(f, s, k) or NaN if p is below intrinsic.
+		template<class F, class P, class K>
+		inline F implied(F f, P p, K k)
+		{
+			return bachelier::implied(math::fabs(F(k - f)), F(p - std::max(F(k - f), F(0))));
+		}
+
+		// Batch s[i] = implied(f[i], p[i], k[i]).
+		template<class F, class P, class K>
+		inline void implied(size_t n, const F* f, const P* p, const K* k, F* s)
+		{
+			for (size_t i = 0; i < n; ++i) {
+				s[i] = implied(f[i], p[i], k[i]);
+			}
+		}
+
+	} // namespace put
+
+	namespace call {
+
+		template<class F, class S, class K>
+		inline F value(F f, S s, K k)
+		{
+			return put::value(k, s, f); // symmetric in f and k
+		}
+
+		template<class F, class S, class K>
+		inline F delta(F f, S s, K k)
+		{
+			return 1 + put::delta(f, s, k);
+		}
+
+		template<class F, class S, class K>
+		inline F gamma(F f, S s, K k)
+		{
+			return put::gamma(f, s, k);
+		}
+
+		template<class F, class S, class K>
+		inline F vega(F f, S s, K k)
+		{
+			return put::vega(f, s, k);
+		}
+
+		template<class F, class S, class K>
+		inline void value(size_t n, const F* f, const S* s, const K* k, F* v)
+		{
+			put::value(n, k, s, f, v);
+		}
+
+		// Batch value, delta N(d) and vega in one pass.
+		template<class F, class S, class K>
+		inline void greeks(size_t n, const F* f, const S* s, const K* k, F* v, F* dv, F* vv)
+		{
+			constexpr F sqrt1_2 = F(1) / std::numbers::sqrt2_v<F>;
+			const F one_sqrt2pi = F(1) / std::sqrt(2 * std::numbers::pi_v<F>);
+
+			for (size_t i = 0; i < n; ++i) {
+				const F s_ = std::max(F(s[i]), math::epsilon<F>);
+				const F d = (f[i] - k[i]) / s_;
+				const F N = std::erfc(-d * sqrt1_2) / 2;
+				const F n_ = std::exp(-d * d / 2) * one_sqrt2pi;
+				v[i] = (f[i] - k[i]) * N + s_ * n_;
+				dv[i] = N;
+				vv[i] = n_;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				if (s[i] <= 0) {
+					v[i] = value(f[i], s[i], k[i]);
+					dv[i] = delta(f[i], s[i], k[i]);
+					vv[i] = vega(f[i], s[i], k[i]);
+				}
+			}
+		}
+
+		// Return s with c = value(f, s, k).
+		template<class F, class C, class K>
+		inline F implied(F f, C c, K k)
+		{
+			return bachelier::implied(math::fabs(F(f - k)), F(c - std::max(F(f - k), F(0))));
+		}
+
+		template<class F, class C, class K>
+		inline void implied(size_t n, const F* f, const C* c, const K* k, F* s)
+		{
+			for (size_t i = 0; i < n; ++i) {
+				s[i] = implied(f[i], c[i], k[i]);
+			}
+		}
+
+	} // namespace call
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		{
+			// negative forward and strike
+			const double f = -0.002, s = 0.006, k = 0.001;
+			const double h = 1e-6;
+			assert(math::fabs(call::value(f, s, k) - put::value(f, s, k) - (f - k)) < 1e-16);
+			const double d = (call::value(f + h, s, k) - call::value(f - h, s, k)) / (2 * h);
+			assert(math::fabs(call::delta(f, s, k) - d) < 1e-8);
+			const double g = (call::delta(f + h, s, k) - call::delta(f - h, s, k)) / (2 * h);
+			assert(math::fabs(call::gamma(f, s, k) - g) < 1e-4);
+			const double v = (put::value(f, s + h, k) - put::value(f, s - h, k)) / (2 * h);
+			assert(math::fabs(put::vega(f, s, k) - v) < 1e-8);
+			assert(put::value(f, 0., k) == k - f);
+			// degenerate gamma is a point mass at the strike
+			assert(put::gamma(0.01, 0., 0.02) == 0);
+			assert(put::gamma(0.01, 0., 0.01) == math::infinity<double>);
+		}
+		{
+			// implied round trip across moneyness
+			for (double k = -0.05; k <= 0.05; k += 0.001) {
+				for (double s : { 1e-4, 0.001, 0.01, 0.05 }) {
+					const double f = 0.002;
+					const double p = put::value(f, s, k);
+					if (p - std::max(k - f, 0.) < 1e-10 * std::max(p, call::value(f, s, k))) {
+						continue; // time value lost to rounding in the price
+					}
+					assert(math::fabs(put::implied(f, p, k) - s) <= 1e-9 * s);
+					assert(math::fabs(call::implied(f, call::value(f, s, k), k) - s) <= 1e-9 * s);
+				}
+			}
+			assert(0 == put::implied(0., 0.01, 0.01));
+			assert(std::isnan(put::implied(0., 0.005, 0.01)));
+		}
+		{
+			const double f[] = { 0.01, -0.01, 0.02, 0, 0.01, 0.01 };
+			const double s[] = { 0.01, 0.005, 0.02, 0.01, 0, 0 };
+			const double k[] = { 0.01, 0.00, 0.015, -0.01, 0.005, 0.01 };
+			double v[6], dv[6], vv[6], s_[6];
+			call::value(6, f, s, k, v);
+			for (size_t i = 0; i < 6; ++i) {
+				assert(math::fabs(v[i] - call::value(f[i], s[i], k[i])) < 1e-16);
+			}
+			call::greeks(6, f, s, k, v, dv, vv);
+			for (size_t i = 0; i < 6; ++i) {
+				assert(math::fabs(v[i] - call::value(f[i], s[i], k[i])) < 1e-16);
+				assert(math::fabs(dv[i] - call::delta(f[i], s[i], k[i])) < 1e-15);
+				assert(math::fabs(vv[i] - call::vega(f[i], s[i], k[i])) < 1e-15);
+			}
+			call::implied(4, f, v, k, s_);
+			for (size_t i = 0; i < 4; ++i) {
+				assert(math::fabs(s_[i] - s[i]) < 1e-9 * s[i]);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::option::bachelier
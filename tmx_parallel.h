@@ -0,0 +1,92 @@
+// tmx_parallel.h - Split index ranges across threads.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace tmx::parallel {
+
+	// Number of hardware threads, at least one.
+	inline unsigned concurrency()
+	{
+		unsigned p = std::thread::hardware_concurrency();
+
+		return p ? p : 1;
+	}
+
+	// Number of chunks used by for_chunks to cover n items with at most p threads.
+	inline unsigned chunks(size_t n, unsigned p = concurrency(), size_t grain = 1)
+	{
+		if (n == 0) {
+			return 0;
+		}
+		grain = std::max<size_t>(grain, 1);
+
+		return static_cast<unsigned>(std::min<size_t>(std::max(p, 1u), (n + grain - 1) / grain));
+	}
+
+	// Call f(k, b, e) for chunk k covering [b, e) of [0, n) using chunks(n, p, grain) threads.
+	// The calling thread runs the last chunk.
+	template<class F>
+	inline void for_chunks(size_t n, const F& f, unsigned p = concurrency(), size_t grain = 1)
+	{
+		const unsigned k = chunks(n, p, grain);
+		if (k == 0) {
+			return;
+		}
+		const size_t step = (n + k - 1) / k;
+
+		std::vector<std::thread> ts;
+		ts.reserve(k - 1);
+		for (unsigned i = 0; i + 1 < k; ++i) {
+			ts.emplace_back([&f, i, step, n]() { f(i, std::min(i * step, n), std::min((i + 1) * step, n)); });
+		}
+		f(k - 1, std::min((k - 1) * step, n), n);
+
+		for (auto& t : ts) {
+			t.join();
+		}
+	}
+
+	// Call f(i) for i in [0, n).
+	template<class F>
+	inline void for_each(size_t n, const F& f, unsigned p = concurrency(), size_t grain = 1)
+	{
+		for_chunks(n, [&f](unsigned, size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				f(i);
+			}
+		}, p, grain);
+	}
+
+#ifdef _DEBUG
+	inline int for_chunks_test()
+	{
+		{
+			assert(0 == chunks(0, 4));
+			assert(1 == chunks(1, 4));
+			assert(4 == chunks(100, 4));
+			assert(2 == chunks(100, 4, 50));
+		}
+		{
+			std::vector<int> v(1000, 0);
+			for_each(v.size(), [&v](size_t i) { v[i] = static_cast<int>(i); }, 4);
+			for (size_t i = 0; i < v.size(); ++i) {
+				assert(v[i] == static_cast<int>(i));
+			}
+		}
+		{
+			std::atomic<size_t> n = 0;
+			for_chunks(10, [&n](unsigned, size_t b, size_t e) { n += e - b; }, 3);
+			assert(n == 10);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::parallel
@@ -13,6 +13,9 @@
 	Note f(t[i]) = f[i].
 */
 #pragma once
+#ifdef _DEBUG
+#include <cassert>
+#endif // _DEBUG
 #include <cmath>
 #include <algorithm>
 #include <limits>
@@ -130,6 +133,47 @@ namespace tmx {
 #undef IS_NAN
 #endif // _DEBUG
 
+		// Batch I[j] = integral(u[j], n, t, f, _f) for increasing u[j] in one walk over the knots.
+		template<class T, class F>
+		inline void integral(size_t m, const T* u, size_t n, const T* t, const F* f, F _f, F* I)
+		{
+			F I_ = 0;  // integral to t_
+			T t_ = 0;
+			size_t i = 0;
+			for (size_t j = 0; j < m; ++j) {
+				if (u[j] < 0) {
+					I[j] = math::NaN<F>;
+					continue;
+				}
+				while (i < n && t[i] <= u[j]) {
+					I_ += f[i] * (t[i] - t_);
+					t_ = t[i];
+					++i;
+				}
+				I[j] = u[j] > t_ ? I_ + (i == n ? _f : f[i]) * (u[j] - t_) : I_;
+			}
+		}
+#ifdef _DEBUG
+		inline int integral_batch_test()
+		{
+			{
+				const double t[] = { 1,2,3 };
+				const double f[] = { 4,5,6 };
+				const double u[] = { 0, 0.5, 1, 1, 1.5, 2, 2.5, 3, 3.5, 10 };
+				double I[10];
+				integral(10, u, 3, t, f, 7., I);
+				for (size_t j = 0; j < 10; ++j) {
+					assert(I[j] == integral(u[j], 3, t, f, 7.));
+				}
+				integral(0, u, 3, t, f, 7., I);
+				integral(3, u, 0, t, f, 7., I);
+				assert(I[1] == 7 * 0.5);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+
 		// discount D(u) = exp(-int_0^u f(t) dt)
 		template<class T, class F>
 		constexpr F discount(T u, size_t n, const T* t, const F* f, F _f = math::NaN<F>)
@@ -0,0 +1,257 @@
+// tmx_registry.h - Minimal perfect hash from CUSIP/ISIN to dense instrument index.
+// Built once per day. Identifiers of up to 16 characters are packed into two
+// 64-bit words. Keys are split into buckets by one hash and each bucket gets a
+// displacement that sends all its keys to free slots of a table with exactly n
+// slots (hash and displace). A lookup is two hashes, one displacement load and
+// one key compare. Batch lookups run each stage over a block of keys so the
+// integer arithmetic vectorizes and the loads can overlap.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <string>
+#endif // _DEBUG
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <string_view>
+#include <vector>
+#include "ensure.h"
+
+namespace tmx::registry {
+
+	// Packed identifier.
+	struct key {
+		uint64_t lo = 0, hi = 0;
+
+		bool operator==(const key&) const = default;
+		auto operator<=>(const key&) const = default;
+	};
+
+	// Pack up to 16 characters, zero padded.
+	inline key pack(std::string_view s)
+	{
+		ensure(s.size() <= 16);
+
+		char b[16] = { 0 };
+		std::memcpy(b, s.data(), s.size());
+		key k;
+		std::memcpy(&k.lo, b, 8);
+		std::memcpy(&k.hi, b + 8, 8);
+
+		return k;
+	}
+
+	constexpr uint64_t mix(uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	constexpr uint64_t hash(uint64_t lo, uint64_t hi)
+	{
+		return mix(lo * 0x9e3779b97f4a7c15ull ^ hi);
+	}
+	// Map h uniformly to [0, n) without division.
+	constexpr uint32_t range(uint64_t h, uint32_t n)
+	{
+		return static_cast<uint32_t>(((h >> 32) * n) >> 32);
+	}
+
+	class index {
+		uint32_t n = 0;      // number of keys
+		uint32_t nb = 0;     // number of buckets
+		std::vector<uint32_t> d;  // displacement of each bucket
+		std::vector<key> k;       // key in each slot
+		std::vector<uint32_t> i;  // dense index in each slot
+
+		uint32_t bucket(uint64_t h) const
+		{
+			return range(h, nb);
+		}
+		uint32_t slot(uint64_t h, uint32_t d_) const
+		{
+			return range(mix(h + d_ * 0x9e3779b97f4a7c15ull), n);
+		}
+	public:
+		static constexpr uint32_t npos = UINT32_MAX;
+
+		index() = default;
+		// Identifier ids[j] maps to dense index j.
+		index(size_t n_, const std::string_view* ids)
+			: n(static_cast<uint32_t>(n_)), nb(std::max<uint32_t>(1, static_cast<uint32_t>(n_ / 4))),
+			  d(nb, 0), k(n_), i(n_, npos)
+		{
+			ensure(n_ < npos);
+
+			std::vector<key> ks(n);
+			std::vector<uint64_t> hs(n);
+			for (uint32_t j = 0; j < n; ++j) {
+				ks[j] = pack(ids[j]);
+				hs[j] = hash(ks[j].lo, ks[j].hi);
+			}
+			{
+				auto ks_ = ks;
+				std::sort(ks_.begin(), ks_.end());
+				ensure_message(std::adjacent_find(ks_.begin(), ks_.end()) == ks_.end(), "registry::index: duplicate identifier");
+			}
+
+			// keys by bucket, largest buckets first
+			std::vector<uint32_t> start(nb + 1, 0), order(n);
+			for (uint32_t j = 0; j < n; ++j) {
+				++start[bucket(hs[j]) + 1];
+			}
+			std::partial_sum(start.begin(), start.end(), start.begin());
+			{
+				auto next = start;
+				for (uint32_t j = 0; j < n; ++j) {
+					order[next[bucket(hs[j])]++] = j;
+				}
+			}
+			std::vector<uint32_t> bs(nb);
+			std::iota(bs.begin(), bs.end(), 0u);
+			std::stable_sort(bs.begin(), bs.end(), [&start](uint32_t a, uint32_t b) {
+				return start[a + 1] - start[a] > start[b + 1] - start[b];
+			});
+
+			std::vector<bool> used(n, false);
+			std::vector<uint32_t> pos;
+			for (uint32_t b : bs) {
+				const uint32_t* kb = order.data() + start[b];
+				const uint32_t m = start[b + 1] - start[b];
+				if (m == 0) {
+					break;
+				}
+				for (uint32_t d_ = 0;; ++d_) {
+					ensure(d_ != UINT32_MAX);
+					pos.clear();
+					bool ok = true;
+					for (uint32_t j = 0; ok && j < m; ++j) {
+						const uint32_t s = slot(hs[kb[j]], d_);
+						ok = !used[s] && std::find(pos.begin(), pos.end(), s) == pos.end();
+						pos.push_back(s);
+					}
+					if (ok) {
+						d[b] = d_;
+						for (uint32_t j = 0; j < m; ++j) {
+							used[pos[j]] = true;
+							k[pos[j]] = ks[kb[j]];
+							i[pos[j]] = kb[j];
+						}
+						break;
+					}
+				}
+			}
+		}
+		index(const std::vector<std::string_view>& ids)
+			: index(ids.size(), ids.data())
+		{ }
+		index(const index&) = default;
+		index& operator=(const index&) = default;
+		index(index&&) = default;
+		index& operator=(index&&) = default;
+		~index() = default;
+
+		size_t size() const
+		{
+			return n;
+		}
+
+		// Dense index of id or npos.
+		uint32_t find(std::string_view id) const
+		{
+			if (n == 0 || id.size() > 16) {
+				return npos;
+			}
+			const key k_ = pack(id);
+			const uint64_t h = hash(k_.lo, k_.hi);
+			const uint32_t s = slot(h, d[bucket(h)]);
+
+			return k[s] == k_ ? i[s] : npos;
+		}
+
+		// Dense indices of m identifiers.
+		void find(size_t m, const std::string_view* ids, uint32_t* out) const
+		{
+			constexpr size_t B = 64;
+			uint64_t lo[B], hi[B], h[B];
+			uint32_t s[B];
+
+			for (size_t b = 0; b < m; b += B) {
+				const size_t e = std::min(m - b, B);
+				if (n == 0) {
+					std::fill(out + b, out + b + e, npos);
+					continue;
+				}
+				for (size_t j = 0; j < e; ++j) {
+					const std::string_view& id = ids[b + j];
+					const key k_ = id.size() <= 16 ? pack(id) : key{ UINT64_MAX, UINT64_MAX };
+					lo[j] = k_.lo;
+					hi[j] = k_.hi;
+				}
+				for (size_t j = 0; j < e; ++j) {
+					h[j] = hash(lo[j], hi[j]);
+				}
+				for (size_t j = 0; j < e; ++j) {
+					s[j] = slot(h[j], d[bucket(h[j])]);
+				}
+				for (size_t j = 0; j < e; ++j) {
+					const key& k_ = k[s[j]];
+					out[b + j] = (k_.lo == lo[j]) & (k_.hi == hi[j]) ? i[s[j]] : npos;
+				}
+			}
+		}
+
+#ifdef _DEBUG
+		static int test()
+		{
+			{
+				index r;
+				assert(0 == r.size());
+				assert(npos == r.find("912828ZT0"));
+			}
+			{
+				std::string_view ids[] = { "912828ZT0", "US912828ZT09", "037833100" };
+				index r(3, ids);
+				assert(3 == r.size());
+				assert(0 == r.find("912828ZT0"));
+				assert(1 == r.find("US912828ZT09"));
+				assert(2 == r.find("037833100"));
+				assert(npos == r.find("037833101"));
+				assert(npos == r.find("US912828ZT09XXXXXXX"));
+			}
+			{
+				const size_t n = 20'000;
+				std::vector<std::string> s(n);
+				uint64_t x = 1;
+				for (size_t j = 0; j < n; ++j) {
+					x = mix(x + j);
+					s[j] = std::to_string(x).substr(0, 9); // CUSIP-like
+					if (j % 2) {
+						s[j] = "US" + s[j] + "0";          // ISIN-like
+					}
+				}
+				std::sort(s.begin(), s.end());
+				s.erase(std::unique(s.begin(), s.end()), s.end());
+				std::vector<std::string_view> ids(s.begin(), s.end());
+				index r(ids);
+				for (uint32_t j = 0; j < ids.size(); ++j) {
+					assert(j == r.find(ids[j]));
+				}
+				std::vector<uint32_t> out(ids.size());
+				r.find(ids.size(), ids.data(), out.data());
+				for (uint32_t j = 0; j < ids.size(); ++j) {
+					assert(j == out[j]);
+				}
+				std::string_view missing[] = { "XXXXXXXXX", "", "US0000000000" };
+				uint32_t o[3];
+				r.find(3, missing, o);
+				assert(npos == o[0] && npos == o[1] && npos == o[2]);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+} // namespace tmx::registry
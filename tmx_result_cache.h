@@ -0,0 +1,283 @@
+// tmx_result_cache.h - Concurrent cache of analytics keyed by instrument, curve version and analytic.
+// Fixed size table of slots guarded by sequence locks. Readers never block and
+// only write a reference bit on a hit that does not have it set. A writer claims a slot by making its sequence odd and
+// skips the insert if another writer holds it. Keys include the curve version,
+// so republishing a curve makes old entries unreachable. The cache tracks the
+// latest version seen for each curve and inserts evict stale entries in the
+// probe window first, then use a clock reference bit that readers set on hits.
+// Rarely republished curves keep low versions, so age alone would evict their
+// current results before the stale results of fast moving curves.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <thread>
+#include <vector>
+#endif // _DEBUG
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "ensure.h"
+#include "tmx_curve_handle.h"
+
+namespace tmx::result {
+
+	// Analytics cached per instrument and curve.
+	enum class analytic : uint32_t {
+		present,
+		duration,
+		convexity,
+		yield,
+		spread,
+	};
+
+	template<class X = double>
+	class cache {
+		struct slot {
+			std::atomic<uint64_t> seq = 0;     // odd while being written
+			std::atomic<uint64_t> key = 0;     // instrument id and analytic
+			std::atomic<uint64_t> version = 0; // curve version, 0 if empty
+			std::atomic<uint32_t> curve = 0;   // index into latest
+			std::atomic<bool> used = false;    // clock reference bit
+			std::atomic<X> x = X{};
+		};
+		std::unique_ptr<slot[]> s;
+		size_t mask;
+		unsigned probe;
+		std::unique_ptr<std::atomic<uint64_t>[]> latest; // latest version seen per curve
+		uint32_t curves;
+
+		static uint64_t pack(uint32_t id, analytic a)
+		{
+			return (uint64_t(id) << 32) | uint64_t(a);
+		}
+		static uint64_t mix(uint64_t z)
+		{
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			return z ^ (z >> 31);
+		}
+		size_t home(uint64_t key, uint64_t version) const
+		{
+			return mix(key ^ mix(version)) & mask;
+		}
+	public:
+		// Table with at least n slots probing up to probe slots per key.
+		// Curves are numbered 0 <= curve < curves by the caller.
+		cache(size_t n = 1 << 16, unsigned probe = 4, uint32_t curves = 64)
+			: probe(probe), latest(std::make_unique<std::atomic<uint64_t>[]>(curves)), curves(curves)
+		{
+			size_t m = 1;
+			while (m < n) {
+				m <<= 1;
+			}
+			s = std::make_unique<slot[]>(m);
+			mask = m - 1;
+		}
+		cache(const cache&) = delete;
+		cache& operator=(const cache&) = delete;
+		~cache() = default;
+
+		size_t capacity() const
+		{
+			return mask + 1;
+		}
+
+		// Record version as seen for curve. Older versions of curve become stale.
+		void seen(uint32_t curve, uint64_t version)
+		{
+			ensure(curve < curves);
+
+			uint64_t v = latest[curve].load(std::memory_order_relaxed);
+			while (v < version && !latest[curve].compare_exchange_weak(v, version, std::memory_order_relaxed)) {
+			}
+		}
+
+		// Cached value or nullopt. Lock free. Hits set the reference bit of the slot.
+		std::optional<X> find(uint32_t id, uint64_t version, analytic a) const
+		{
+			const uint64_t key = pack(id, a);
+			const size_t h = home(key, version);
+			for (unsigned k = 0; k < probe; ++k) {
+				const slot& e = s[(h + k) & mask];
+				const uint64_t s0 = e.seq.load(std::memory_order_acquire);
+				if (s0 & 1) {
+					continue;
+				}
+				const uint64_t key_ = e.key.load(std::memory_order_relaxed);
+				const uint64_t version_ = e.version.load(std::memory_order_relaxed);
+				const X x = e.x.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (e.seq.load(std::memory_order_relaxed) != s0) {
+					continue;
+				}
+				if (key_ == key && version_ == version) {
+					if (!e.used.load(std::memory_order_relaxed)) {
+						const_cast<slot&>(e).used.store(true, std::memory_order_relaxed);
+					}
+					return x;
+				}
+			}
+
+			return std::nullopt;
+		}
+
+		// Insert or update the value for version of curve. Return false if every candidate slot was busy.
+		// The victim is the same key, else an empty or stale slot, else the first slot in the
+		// probe window with a clear reference bit, clearing the bits passed over.
+		bool insert(uint32_t id, uint32_t curve, uint64_t version, analytic a, X x)
+		{
+			ensure(version != 0);
+			seen(curve, version);
+
+			const uint64_t key = pack(id, a);
+			const size_t h = home(key, version);
+			size_t i = h & mask;
+			bool found = false;
+			for (unsigned k = 0; k < probe && !found; ++k) {
+				const slot& e = s[(h + k) & mask];
+				const uint64_t version_ = e.version.load(std::memory_order_relaxed);
+				if (version_ == version && e.key.load(std::memory_order_relaxed) == key) {
+					i = (h + k) & mask;
+					found = true;
+				}
+			}
+			for (unsigned k = 0; k < probe && !found; ++k) {
+				const slot& e = s[(h + k) & mask];
+				const uint64_t version_ = e.version.load(std::memory_order_relaxed);
+				if (version_ == 0 || version_ < latest[e.curve.load(std::memory_order_relaxed)].load(std::memory_order_relaxed)) {
+					i = (h + k) & mask;
+					found = true;
+				}
+			}
+			for (unsigned k = 0; k < probe && !found; ++k) {
+				slot& e = s[(h + k) & mask];
+				if (!e.used.exchange(false, std::memory_order_relaxed)) {
+					i = (h + k) & mask;
+					found = true;
+				}
+			}
+
+			slot& e = s[i];
+			uint64_t s0 = e.seq.load(std::memory_order_relaxed);
+			if ((s0 & 1) || !e.seq.compare_exchange_strong(s0, s0 + 1, std::memory_order_acquire)) {
+				return false;
+			}
+			std::atomic_thread_fence(std::memory_order_release);
+			e.key.store(key, std::memory_order_relaxed);
+			e.version.store(version, std::memory_order_relaxed);
+			e.curve.store(curve, std::memory_order_relaxed);
+			e.used.store(true, std::memory_order_relaxed);
+			e.x.store(x, std::memory_order_relaxed);
+			e.seq.store(s0 + 2, std::memory_order_release);
+
+			return true;
+		}
+
+		// Cached value for the current curve in h, numbered curve_, else f(curve) computed and cached.
+		template<class T, class F, class Fn>
+		X get(uint32_t id, uint32_t curve_, const curve::handle<T, F>& h, analytic a, const Fn& f)
+		{
+			const auto snap = h.get();
+			ensure(snap);
+			seen(curve_, snap.version);
+
+			if (auto x = find(id, snap.version, a)) {
+				return *x;
+			}
+			const X x = f(*snap);
+			insert(id, curve_, snap.version, a, x);
+
+			return x;
+		}
+
+#ifdef _DEBUG
+		static int test()
+		{
+			{
+				cache<X> c(100);
+				assert(128 == c.capacity());
+				assert(!c.find(1, 1, analytic::present));
+				assert(c.insert(1, 0, 1, analytic::present, X(2)));
+				assert(X(2) == *c.find(1, 1, analytic::present));
+				assert(!c.find(1, 1, analytic::duration));
+				assert(!c.find(1, 2, analytic::present));
+				assert(c.insert(1, 0, 1, analytic::present, X(3)));
+				assert(X(3) == *c.find(1, 1, analytic::present));
+			}
+			{
+				curve::handle<> h;
+				h.emplace<curve::constant<>>(0.05);
+				cache<X> c(1024);
+				int n = 0;
+				const auto pv = [&n](const curve::base<>& f) { ++n; return X(f.discount(1)); };
+				const X x = c.get(7, 0, h, analytic::present, pv);
+				assert(x == c.get(7, 0, h, analytic::present, pv));
+				assert(1 == n);
+				h.emplace<curve::constant<>>(0.06);
+				const X x_ = c.get(7, 0, h, analytic::present, pv);
+				assert(2 == n);
+				assert(x_ < x);
+			}
+			{
+				// bounded: newer versions evict older ones
+				cache<X> c(16, 4);
+				for (uint64_t v = 1; v <= 1000; ++v) {
+					for (uint32_t id = 0; id < 4; ++id) {
+						c.insert(id, 0, v, analytic::present, X(v));
+					}
+				}
+				for (uint32_t id = 0; id < 4; ++id) {
+					assert(!c.find(id, 1, analytic::present));
+					assert(X(1000) == *c.find(id, 1000, analytic::present));
+				}
+			}
+			{
+				// stale entries of a fast curve go before current entries of a slow one
+				cache<X> c(4, 4, 2);
+				assert(c.insert(0, 0, 1, analytic::present, X(1))); // slow curve 0 at version 1
+				assert(c.insert(1, 1, 2, analytic::present, X(2))); // fast curve 1
+				assert(c.insert(1, 1, 3, analytic::present, X(3))); // republished, version 2 is stale
+				assert(c.insert(2, 1, 3, analytic::present, X(3)));
+				assert(c.insert(3, 1, 3, analytic::present, X(3))); // window full, evicts version 2
+				assert(X(1) == *c.find(0, 1, analytic::present));
+				assert(!c.find(1, 2, analytic::present));
+				for (uint32_t id = 1; id < 4; ++id) {
+					assert(X(3) == *c.find(id, 3, analytic::present));
+				}
+				// no stale entries: clock evicts the first entry without a hit since the last sweep
+				assert(c.insert(4, 1, 3, analytic::present, X(3)));
+				size_t n = 0;
+				for (uint32_t id = 0; id < 5; ++id) {
+					n += c.find(id, id == 0 ? 1 : 3, analytic::present).has_value();
+				}
+				assert(4 == n);
+			}
+			{
+				// readers only see values written for their key
+				cache<X> c(64, 2);
+				std::atomic<bool> bad = false;
+				std::vector<std::thread> ts;
+				for (uint32_t t = 0; t < 4; ++t) {
+					ts.emplace_back([&c, &bad, t] {
+						for (uint64_t v = 1; v < 20'000; ++v) {
+							const uint32_t id = t * 100 + uint32_t(v % 50);
+							c.insert(id, t, v, analytic::yield, X(id) + X(v));
+							if (auto x = c.find(id, v - 1, analytic::yield); x && *x != X(id) + X(v - 1)) {
+								bad = true;
+							}
+						}
+					});
+				}
+				for (auto& t : ts) {
+					t.join();
+				}
+				assert(!bad);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+} // namespace tmx::result
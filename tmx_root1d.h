@@ -16,14 +16,14 @@ namespace tmx::root1d {
 			: x0(x0), x1(x1), tolerance(tol), iterations(iter)
 		{ }
 
-		template<class X, class Y>
+		template<class Y>
 		constexpr auto next(X x0, Y y0, X x1, Y y1)
 		{
 			return (x0 * y1 - x1 * y0) / (y1 - y0);
 		}
 
 		// Find root given two initial guesses.
-		template<class F, class X = double, class Y = double>
+		template<class F, class Y = X>
 		constexpr X solve(const F& f)
 		{
 			Y y0 = f(x0);
@@ -71,7 +71,6 @@ namespace tmx::root1d {
 			: x0(x0), tolerance(tol), iterations(iter)
 		{ }
 
-		template<class X, class Y>
 		constexpr auto next(X x0, Y y0, Y dy)
 		{
 			return x0 - y0 / dy;
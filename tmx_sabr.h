@@ -0,0 +1,423 @@
+// tmx_sabr.h - SABR stochastic volatility smile.
+// dF = σ F^β dW, dσ = ν σ dZ, dW dZ = ρ dt, σ(0) = α
+// Implied vols use the Hagan et al. (2002) expansions. black returns the
+// lognormal vol for option::put/call with s = vol sqrt(T). normal returns the
+// normal vol for option::bachelier.
+// Calibration fits (α, ρ, ν) for fixed β to the vols of one expiry by
+// Levenberg-Marquardt with the Jacobian from dual numbers.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include "tmx_option_bachelier.h"
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "tmx_math_dual.h"
+#include "tmx_option.h"
+#include "tmx_parallel.h"
+
+namespace tmx::sabr {
+
+	template<class X = double>
+	struct params {
+		X α, β, ρ, ν;
+	};
+
+	// z/x(z) with x(z) = log((sqrt(1 - 2ρz + z^2) + z - ρ)/(1 - ρ)), continuous at z = 0.
+	template<class X>
+	inline X zx(const X& z, const X& ρ)
+	{
+		using std::log, std::sqrt, math::log, math::sqrt;
+
+		if (math::fabs(math::real(z)) < 1e-6) {
+			return 1 - ρ * z / 2 + (2 - 3 * ρ * ρ) * z * z / 12;
+		}
+
+		return z / log((sqrt(1 - 2 * ρ * z + z * z) + z - ρ) / (1 - ρ));
+	}
+
+	// Lognormal implied vol at strike k for expiry T.
+	template<class F, class X>
+	inline X black(F f, F k, F T, const X& α, F β, const X& ρ, const X& ν)
+	{
+		using std::pow, math::pow;
+
+		const F b = 1 - β;
+		const F fk = f * k;
+		const F m = std::pow(fk, b / 2);
+		const F l = std::log(f / k);
+		const F l2 = l * l;
+		const X z = ν / α * (m * l);
+		const X A = α / (m * (1 + b * b * l2 / 24 + b * b * b * b * l2 * l2 / 1920));
+		const X B = 1 + (b * b / 24 * α * α / (m * m) + ρ * (β / 4 / m) * ν * α + (2 - 3 * ρ * ρ) / 24 * ν * ν) * T;
+
+		return A * zx(z, ρ) * B;
+	}
+	template<class F>
+	inline F black(F f, F k, F T, const params<F>& p)
+	{
+		return black(f, k, T, p.α, p.β, p.ρ, p.ν);
+	}
+
+	// Normal implied vol at strike k for expiry T. For β = 0 this is normal SABR and
+	// f and k may be zero or negative. For β > 0 f and k must be positive, else NaN.
+	template<class F, class X>
+	inline X normal(F f, F k, F T, const X& α, F β, const X& ρ, const X& ν)
+	{
+		if (β == 0) {
+			// mid is (f + k)/2 but every power of it has exponent 0
+			const X z = ν / α * (f - k);
+			const X B = 1 + (2 - 3 * ρ * ρ) / 24 * ν * ν * T;
+
+			return α * zx(z, ρ) * B;
+		}
+		if (!(f > 0 && k > 0)) {
+			return α * math::NaN<F>;
+		}
+
+		const F b = 1 - β;
+		const F fm = std::sqrt(f * k); // geometric mid
+		// (f - k)/int_k^f dx/x^β
+		const F q = math::fabs(f - k) < 1e-12 * fm ? std::pow(fm, β)
+			: b == 0 ? (f - k) / std::log(f / k)
+			: (f - k) * b / (std::pow(f, b) - std::pow(k, b));
+		const X z = ν / α * ((f - k) * std::pow(fm, -β));
+		const X B = 1 + (β * (β - 2) / 24 * std::pow(fm, 2 * β - 2) * α * α + ρ * (β / 4 * std::pow(fm, β - 1)) * ν * α + (2 - 3 * ρ * ρ) / 24 * ν * ν) * T;
+
+		return α * q * zx(z, ρ) * B;
+	}
+	template<class F>
+	inline F normal(F f, F k, F T, const params<F>& p)
+	{
+		return normal(f, k, T, p.α, p.β, p.ρ, p.ν);
+	}
+
+	// Batch vol[i] = black(f, k[i], T, p). Branch-free except for the ATM series.
+	template<class F>
+	inline void black(size_t n, F f, const F* k, F T, const params<F>& p, F* vol)
+	{
+		const F b = 1 - p.β;
+		for (size_t i = 0; i < n; ++i) {
+			const F m = std::pow(f * k[i], b / 2);
+			const F l = std::log(f / k[i]);
+			const F l2 = l * l;
+			const F z = p.ν / p.α * m * l;
+			const F A = p.α / (m * (1 + b * b * l2 / 24 + b * b * b * b * l2 * l2 / 1920));
+			const F B = 1 + (b * b / 24 * p.α * p.α / (m * m) + p.ρ * p.β * p.ν * p.α / (4 * m) + (2 - 3 * p.ρ * p.ρ) / 24 * p.ν * p.ν) * T;
+			const F z_ = math::fabs(z) < 1e-6 ? F(1) : z; // avoid 0/0, replaced below
+			const F x = std::log((std::sqrt(1 - 2 * p.ρ * z_ + z_ * z_) + z_ - p.ρ) / (1 - p.ρ));
+			const F s = math::fabs(z) < 1e-6 ? 1 - p.ρ * z / 2 + (2 - 3 * p.ρ * p.ρ) * z * z / 12 : z_ / x;
+			vol[i] = A * s * B;
+		}
+	}
+
+	// Batch vol[i] = normal(f, k[i], T, p). Powers of f and the mid come from log f,
+	// computed once, and one log per strike. Branch-free except for the ATM series.
+	template<class F>
+	inline void normal(size_t n, F f, const F* k, F T, const params<F>& p, F* vol)
+	{
+		const F β = p.β, b = 1 - β;
+		const F r = p.ν / p.α;
+		const F B0 = (2 - 3 * p.ρ * p.ρ) / 24 * p.ν * p.ν;
+		const auto zx_ = [&p](F z) {
+			const F z_ = math::fabs(z) < 1e-6 ? F(1) : z; // avoid 0/0, replaced below
+			const F x = std::log((std::sqrt(1 - 2 * p.ρ * z_ + z_ * z_) + z_ - p.ρ) / (1 - p.ρ));
+			return math::fabs(z) < 1e-6 ? 1 - p.ρ * z / 2 + (2 - 3 * p.ρ * p.ρ) * z * z / 12 : z_ / x;
+		};
+
+		if (β == 0) {
+			const F B = 1 + B0 * T;
+			for (size_t i = 0; i < n; ++i) {
+				vol[i] = p.α * zx_(r * (f - k[i])) * B;
+			}
+
+			return;
+		}
+
+		const F lf = std::log(f);
+		const F fb = std::exp(b * lf);
+		for (size_t i = 0; i < n; ++i) {
+			const F lk = std::log(k[i]);
+			const F lm = (lf + lk) / 2; // log of the geometric mid
+			const F d = f - k[i];
+			const F mβ = std::exp(β * lm);
+			const F q = math::fabs(d) < 1e-12 * std::exp(lm) ? mβ
+				: b == 0 ? d / (lf - lk)
+				: d * b / (fb - std::exp(b * lk));
+			const F m1 = std::exp((β - 1) * lm); // fm^{β - 1}
+			const F B = 1 + (β * (β - 2) / 24 * m1 * m1 * p.α * p.α + p.ρ * β / 4 * m1 * p.ν * p.α + B0) * T;
+			vol[i] = p.α * q * zx_(r * d / mβ) * B;
+		}
+		if (!(f > 0)) {
+			std::fill(vol, vol + n, math::NaN<F>);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			if (!(k[i] > 0)) {
+				vol[i] = math::NaN<F>;
+			}
+		}
+	}
+
+	// Black call values v[i] on strikes k[i].
+	template<class F>
+	inline void call(size_t n, F f, const F* k, F T, const params<F>& p, F* v)
+	{
+		std::vector<F> s(n), f_(n, f);
+		black(n, f, k, T, p, s.data());
+		for (size_t i = 0; i < n; ++i) {
+			s[i] *= std::sqrt(T);
+		}
+		option::call::value(n, f_.data(), s.data(), k, v);
+	}
+
+	// Market smile of one expiry.
+	template<class F = double>
+	struct slice {
+		F f, T;
+		size_t n;
+		const F* k;
+		const F* vol; // lognormal implied vols
+		const F* w = nullptr; // weights, default 1
+	};
+
+	template<class F = double>
+	struct fit {
+		params<F> p;
+		F rms;    // weighted root mean square vol error
+		int iter; // Levenberg-Marquardt iterations
+		bool converged; // false if stopped by the iteration cap or a damping blowup
+	};
+
+	// Fit (α, ρ, ν) with β fixed. Start from p0 if α > 0 else from the vol closest to the money.
+	// Converged when the residual is below tol or a step changes the parameters by less than tol.
+	template<class F>
+	inline fit<F> calibrate(const slice<F>& s, F β, params<F> p0 = { 0, 0, 0, 0 },
+		F tol = F(1e-12), int iter = 100)
+	{
+		using D = math::dual<F, 3>;
+
+		ensure(s.n >= 3);
+		if (!(p0.α > 0)) {
+			size_t a = 0;
+			for (size_t i = 1; i < s.n; ++i) {
+				if (math::fabs(std::log(s.k[i] / s.f)) < math::fabs(std::log(s.k[a] / s.f))) {
+					a = i;
+				}
+			}
+			p0 = { s.vol[a] * std::pow(s.f, 1 - β), β, F(0), F(0.3) };
+		}
+		p0.β = β;
+
+		// residuals and Jacobian, J row major n x 3
+		std::vector<F> r(s.n), J(3 * s.n);
+		const auto eval = [&](const params<F>& p, bool jacobian) {
+			F e = 0;
+			for (size_t i = 0; i < s.n; ++i) {
+				const F w = s.w ? std::sqrt(s.w[i]) : F(1);
+				if (jacobian) {
+					const D v = black(s.f, s.k[i], s.T, D::variable(p.α, 0), β, D::variable(p.ρ, 1), D::variable(p.ν, 2));
+					r[i] = w * (v.x - s.vol[i]);
+					for (size_t j = 0; j < 3; ++j) {
+						J[3 * i + j] = w * v.d[j];
+					}
+				}
+				else {
+					r[i] = w * (black(s.f, s.k[i], s.T, p.α, β, p.ρ, p.ν) - s.vol[i]);
+				}
+				e += r[i] * r[i];
+			}
+			return e;
+		};
+
+		params<F> p = p0;
+		F e = eval(p, true);
+		F λ = F(1e-3);
+		int k = 0;
+		bool converged = false;
+		for (; k < iter && e > tol * tol && !converged; ++k) {
+			// (J'J + λ diag J'J) δ = -J'r
+			F A[3][3] = {}, g[3] = {};
+			for (size_t i = 0; i < s.n; ++i) {
+				const F* Ji = &J[3 * i];
+				for (size_t a = 0; a < 3; ++a) {
+					g[a] -= Ji[a] * r[i];
+					for (size_t b = 0; b < 3; ++b) {
+						A[a][b] += Ji[a] * Ji[b];
+					}
+				}
+			}
+			bool improved = false;
+			while (!improved && λ < F(1e12)) {
+				F M[3][3];
+				for (size_t a = 0; a < 3; ++a) {
+					for (size_t b = 0; b < 3; ++b) {
+						M[a][b] = A[a][b] + (a == b ? λ * std::max(A[a][a], F(1e-12)) : F(0));
+					}
+				}
+				// Cramer's rule
+				const auto det = [](const F (&m)[3][3]) {
+					return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+					     - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+					     + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+				};
+				const F d = det(M);
+				F δ[3];
+				for (size_t c = 0; c < 3; ++c) {
+					F Mc[3][3];
+					for (size_t a = 0; a < 3; ++a) {
+						for (size_t b = 0; b < 3; ++b) {
+							Mc[a][b] = b == c ? g[a] : M[a][b];
+						}
+					}
+					δ[c] = det(Mc) / d;
+				}
+
+				params<F> q = p;
+				q.α = std::max(p.α + δ[0], p.α / 10);
+				q.ρ = std::clamp(p.ρ + δ[1], F(-0.9999), F(0.9999));
+				q.ν = std::max(p.ν + δ[2], p.ν / 10);
+				const F e_ = eval(q, false);
+				if (e_ < e) {
+					const F step = math::fabs(q.α - p.α) / p.α + math::fabs(q.ρ - p.ρ) + math::fabs(q.ν - p.ν);
+					p = q;
+					e = eval(p, true);
+					λ = std::max(λ / 3, F(1e-12));
+					improved = true;
+					converged = step < tol;
+				}
+				else {
+					λ *= 4;
+				}
+			}
+			if (!improved) {
+				break;
+			}
+		}
+
+		return fit<F>{ p, std::sqrt(e / s.n), k, converged || e <= tol * tol };
+	}
+
+	// Calibrate m expiries in parallel.
+	template<class F>
+	inline void calibrate(size_t m, const slice<F>* s, F β, fit<F>* out, unsigned threads = parallel::concurrency())
+	{
+		parallel::for_each(m, [&](size_t i) { out[i] = calibrate(s[i], β); }, threads);
+	}
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		{
+			// no vol of vol, β = 1 is Black
+			const params<> p{ 0.2, 1, 0, 0 };
+			assert(math::fabs(black(100., 120., 1., p) - 0.2) < 1e-14);
+			const params<> q{ 0.01, 0, 0, 0 };
+			assert(math::fabs(normal(0.02, 0.03, 1., q) - 0.01) < 1e-14);
+		}
+		{
+			// normal SABR with negative and straddling forwards and strikes
+			const params<> q{ 0.006, 0, -0.2, 0.3 };
+			const double T = 1;
+			const double fs[] = { -0.002, -0.002, 0.001, 0 };
+			const double ks[] = { 0.001, -0.004, -0.001, 0 };
+			for (size_t i = 0; i < 4; ++i) {
+				const double z = q.ν / q.α * (fs[i] - ks[i]);
+				const double x = std::log((std::sqrt(1 - 2 * q.ρ * z + z * z) + z - q.ρ) / (1 - q.ρ));
+				const double s = q.α * (z == 0 ? 1 : z / x) * (1 + (2 - 3 * q.ρ * q.ρ) / 24 * q.ν * q.ν * T);
+				assert(math::fabs(normal(fs[i], ks[i], T, q) - s) < 1e-15);
+				double s_;
+				normal(1, fs[i], ks + i, T, q, &s_);
+				assert(math::fabs(s_ - s) < 1e-15);
+			}
+			// β > 0 needs positive forward and strike
+			const params<> r{ 0.006, 0.5, -0.2, 0.3 };
+			assert(std::isnan(normal(-0.002, 0.001, T, r)));
+			double s_;
+			normal(1, 0.01, fs, T, r, &s_);
+			assert(std::isnan(s_));
+		}
+		const double f = 0.03, T = 2;
+		const params<> p{ 0.02, 0.5, -0.3, 0.4 };
+		std::vector<double> k(15), v(15), w(15);
+		for (size_t i = 0; i < 15; ++i) {
+			k[i] = f * (0.5 + 0.1 * i);
+		}
+		{
+			// batch and dual number evaluation agree with scalar
+			black(15, f, k.data(), T, p, v.data());
+			for (size_t i = 0; i < 15; ++i) {
+				assert(math::fabs(v[i] - black(f, k[i], T, p)) < 1e-15);
+			}
+			using D = math::dual<double, 3>;
+			const double h = 1e-7;
+			for (size_t i = 0; i < 15; ++i) {
+				const D x = black(f, k[i], T, D::variable(p.α, 0), p.β, D::variable(p.ρ, 1), D::variable(p.ν, 2));
+				assert(math::fabs(x.x - v[i]) < 1e-15);
+				const double dα = (black(f, k[i], T, p.α + h, p.β, p.ρ, p.ν) - black(f, k[i], T, p.α - h, p.β, p.ρ, p.ν)) / (2 * h);
+				const double dρ = (black(f, k[i], T, p.α, p.β, p.ρ + h, p.ν) - black(f, k[i], T, p.α, p.β, p.ρ - h, p.ν)) / (2 * h);
+				const double dν = (black(f, k[i], T, p.α, p.β, p.ρ, p.ν + h) - black(f, k[i], T, p.α, p.β, p.ρ, p.ν - h)) / (2 * h);
+				assert(math::fabs(x.d[0] - dα) < 1e-6);
+				assert(math::fabs(x.d[1] - dρ) < 1e-7);
+				assert(math::fabs(x.d[2] - dν) < 1e-7);
+			}
+			normal(15, f, k.data(), T, p, w.data());
+			for (size_t i = 0; i < 15; ++i) {
+				assert(math::fabs(w[i] / normal(f, k[i], T, p) - 1) < 1e-14);
+				// both expansions give nearly the same prices near the money
+				if (math::fabs(k[i] - f) < 0.2 * f) {
+					const double c = option::call::value(f, v[i] * std::sqrt(T), k[i]);
+					const double s = option::bachelier::call::implied(f, c, k[i]) / std::sqrt(T);
+					assert(math::fabs(w[i] / s - 1) < 1e-3);
+				}
+			}
+			double c[15];
+			call(15, f, k.data(), T, p, c);
+			assert(math::fabs(c[5] - option::call::value(f, v[5] * std::sqrt(T), k[5])) < 1e-15);
+		}
+		{
+			// recover parameters from model vols
+			const slice<> s{ f, T, 15, k.data(), v.data() };
+			const auto x = calibrate(s, 0.5);
+			assert(x.converged);
+			assert(x.rms < 1e-10);
+			assert(math::fabs(x.p.α - p.α) < 1e-7);
+			assert(math::fabs(x.p.ρ - p.ρ) < 1e-5);
+			assert(math::fabs(x.p.ν - p.ν) < 1e-5);
+			// the iteration cap is reported, not taken as a fit
+			const auto y = calibrate(s, 0.5, params<>{ 0, 0, 0, 0 }, 1e-12, 2);
+			assert(!y.converged && 2 == y.iter);
+			assert(y.rms > x.rms);
+			// with no tolerance the damping blows up at the best fit of noisy vols
+			std::vector<double> u(v);
+			for (size_t i = 0; i < 15; ++i) {
+				u[i] += (i % 2 ? 1e-4 : -1e-4);
+			}
+			const auto z = calibrate(slice<>{ f, T, 15, k.data(), u.data() }, 0.5, params<>{ 0, 0, 0, 0 }, 0., 1000);
+			assert(!z.converged && z.iter < 1000);
+			assert(z.rms < 2e-4);
+		}
+		{
+			// many expiries in parallel
+			const size_t m = 8;
+			std::vector<std::vector<double>> vs(m, std::vector<double>(15));
+			std::vector<slice<>> ss;
+			for (size_t j = 0; j < m; ++j) {
+				const params<> pj{ 0.015 + 0.001 * j, 0.5, -0.5 + 0.1 * j, 0.2 + 0.05 * j };
+				black(15, f, k.data(), 0.5 + j, pj, vs[j].data());
+				ss.push_back(slice<>{ f, 0.5 + j, 15, k.data(), vs[j].data() });
+			}
+			std::vector<fit<>> out(m);
+			calibrate(m, ss.data(), 0.5, out.data(), 4);
+			for (size_t j = 0; j < m; ++j) {
+				assert(out[j].converged);
+				assert(out[j].rms < 1e-9);
+				assert(math::fabs(out[j].p.ρ - (-0.5 + 0.1 * j)) < 1e-4);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::sabr
@@ -0,0 +1,368 @@
+// tmx_scenario.h - Instrument by scenario present values in a fixed memory budget.
+// The M x N matrix of PVs is never held in memory. Scenarios are processed in
+// blocks; within a block, tiles of instruments are priced in parallel and each
+// tile is streamed to sinks. When a block is complete the sinks are told so
+// they can fold per-scenario totals into online statistics.
+//
+// A sink has
+//   void tile(const scenario::tile&)  // called concurrently from workers
+//   void end(size_t s0, size_t s1)    // called once per finished block
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <filesystem>
+#endif // _DEBUG
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "ensure.h"
+#include "tmx_parallel.h"
+
+namespace tmx::scenario {
+
+	// PVs of instruments [i0, i1) in scenarios [s0, s1), pv[(i - i0) * (s1 - s0) + (s - s0)].
+	struct tile {
+		size_t i0, i1, s0, s1;
+		const double* pv;
+
+		size_t width() const
+		{
+			return s1 - s0;
+		}
+		const double* row(size_t i) const
+		{
+			return pv + (i - i0) * width();
+		}
+	};
+
+	struct options {
+		size_t budget = size_t(64) << 20; // bytes for tiles and block buffers
+		size_t block = 256;               // maximum scenarios per block
+		unsigned threads = parallel::concurrency();
+	};
+
+	// Call pv(i0, i1, s0, s1, out) to fill tiles of the M x N matrix and stream them to sinks.
+	template<class PV, class... Sink>
+	inline void run(size_t M, size_t N, const PV& pv, const options& o, Sink&... sink)
+	{
+		if (M == 0 || N == 0) {
+			return;
+		}
+		const size_t nb = std::min(N, std::max<size_t>(o.block, 1));
+		const unsigned p = std::max(o.threads, 1u);
+		// one tile per thread
+		const size_t per_thread = o.budget / sizeof(double) / p;
+		const size_t mt = std::clamp<size_t>(per_thread / nb, 1, M);
+		const size_t tiles = (M + mt - 1) / mt;
+
+		std::vector<std::vector<double>> buf(parallel::chunks(tiles, p));
+		for (size_t s0 = 0; s0 < N; s0 += nb) {
+			const size_t s1 = std::min(N, s0 + nb);
+			parallel::for_chunks(tiles, [&](unsigned k, size_t b, size_t e) {
+				auto& out = buf[k];
+				out.resize(mt * (s1 - s0));
+				for (size_t t = b; t < e; ++t) {
+					const size_t i0 = t * mt;
+					const size_t i1 = std::min(M, i0 + mt);
+					pv(i0, i1, s0, s1, out.data());
+					const scenario::tile x{ i0, i1, s0, s1, out.data() };
+					(sink.tile(x), ...);
+				}
+			}, p);
+			(sink.end(s0, s1), ...);
+		}
+	}
+
+	// Online estimate of one quantile with five markers (P-square algorithm).
+	class p2 {
+		double q;
+		size_t n = 0;
+		std::array<double, 5> h{};   // marker heights
+		std::array<double, 5> pos{}; // marker positions
+		std::array<double, 5> des{}; // desired positions
+		std::array<double, 5> inc{}; // desired position increments
+	public:
+		p2(double q = 0.5)
+			: q(q), des{ 1, 1 + 2 * q, 1 + 4 * q, 3 + 2 * q, 5 }, inc{ 0, q / 2, q, (1 + q) / 2, 1 }
+		{
+			pos = { 1, 2, 3, 4, 5 };
+		}
+
+		size_t count() const
+		{
+			return n;
+		}
+
+		void add(double x)
+		{
+			if (n < 5) {
+				h[n++] = x;
+				if (n == 5) {
+					std::sort(h.begin(), h.end());
+				}
+				return;
+			}
+			++n;
+
+			size_t k;
+			if (x < h[0]) {
+				h[0] = x;
+				k = 0;
+			}
+			else if (x >= h[4]) {
+				h[4] = std::max(h[4], x);
+				k = 3;
+			}
+			else {
+				k = 0;
+				while (x >= h[k + 1]) {
+					++k;
+				}
+			}
+			for (size_t i = k + 1; i < 5; ++i) {
+				pos[i] += 1;
+			}
+			for (size_t i = 0; i < 5; ++i) {
+				des[i] += inc[i];
+			}
+			for (size_t i = 1; i < 4; ++i) {
+				const double d = des[i] - pos[i];
+				if ((d >= 1 && pos[i + 1] - pos[i] > 1) || (d <= -1 && pos[i - 1] - pos[i] < -1)) {
+					const double s = d > 0 ? 1 : -1;
+					// parabolic prediction, linear if it leaves the bracket
+					double y = h[i] + s / (pos[i + 1] - pos[i - 1])
+						* ((pos[i] - pos[i - 1] + s) * (h[i + 1] - h[i]) / (pos[i + 1] - pos[i])
+						 + (pos[i + 1] - pos[i] - s) * (h[i] - h[i - 1]) / (pos[i] - pos[i - 1]));
+					if (!(h[i - 1] < y && y < h[i + 1])) {
+						const size_t j = s > 0 ? i + 1 : i - 1;
+						y = h[i] + s * (h[j] - h[i]) / (pos[j] - pos[i]);
+					}
+					h[i] = y;
+					pos[i] += s;
+				}
+			}
+		}
+
+		// Current estimate.
+		double value() const
+		{
+			if (n == 0) {
+				return std::nan("");
+			}
+			if (n < 5) {
+				std::array<double, 5> s = h;
+				std::sort(s.begin(), s.begin() + n);
+				return s[std::min(n - 1, static_cast<size_t>(q * n))];
+			}
+
+			return h[2];
+		}
+	};
+
+	// Per-portfolio totals of each scenario folded into sums and quantile sketches.
+	class aggregate {
+		std::vector<unsigned> g;    // portfolio of each instrument
+		size_t P;
+		std::vector<double> block;  // P x block width totals of current block
+		size_t width = 0;
+		std::mutex m;
+		std::vector<double> s1, s2; // sum and sum of squares over scenarios
+		std::vector<p2> qs;
+		size_t n = 0;               // scenarios seen
+	public:
+		// Instrument i belongs to portfolio g[i] < P. Track quantile q of each portfolio's PV.
+		aggregate(size_t M, const unsigned* g, size_t P, double q = 0.01)
+			: g(g, g + M), P(P), s1(P, 0), s2(P, 0), qs(P, p2(q))
+		{ }
+
+		void tile(const scenario::tile& t)
+		{
+			std::vector<double> local(P * t.width(), 0);
+			for (size_t i = t.i0; i < t.i1; ++i) {
+				double* l = local.data() + g[i] * t.width();
+				const double* r = t.row(i);
+				for (size_t s = 0; s < t.width(); ++s) {
+					l[s] += r[s];
+				}
+			}
+			std::lock_guard lock(m);
+			if (width != t.width()) {
+				width = t.width();
+				block.assign(P * width, 0);
+			}
+			for (size_t k = 0; k < local.size(); ++k) {
+				block[k] += local[k];
+			}
+		}
+		void end(size_t s0, size_t s1_)
+		{
+			const size_t w = s1_ - s0;
+			if (width != w) { // no tiles for this block
+				width = w;
+				block.assign(P * width, 0);
+			}
+			for (size_t p = 0; p < P; ++p) {
+				for (size_t s = 0; s < w; ++s) {
+					const double x = block[p * w + s];
+					s1[p] += x;
+					s2[p] += x * x;
+					qs[p].add(x);
+				}
+			}
+			n += w;
+			std::fill(block.begin(), block.end(), 0.);
+		}
+
+		size_t scenarios() const
+		{
+			return n;
+		}
+		double mean(size_t p) const
+		{
+			return s1[p] / n;
+		}
+		double stdev(size_t p) const
+		{
+			const double m_ = mean(p);
+			return std::sqrt(std::max(0., s2[p] / n - m_ * m_));
+		}
+		double quantile(size_t p) const
+		{
+			return qs[p].value();
+		}
+	};
+
+#ifndef _WIN32
+	// Spill the full matrix, instrument major, to a memory-mapped file.
+	class spill {
+		std::string path;
+		size_t M, N;
+		double* x = nullptr;
+	public:
+		spill(const std::string& path, size_t M, size_t N)
+			: path(path), M(M), N(N)
+		{
+			const int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+			ensure_message(fd >= 0, "scenario::spill: cannot open " + path);
+			const size_t size = std::max<size_t>(1, M * N) * sizeof(double);
+			if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+				::close(fd);
+				ensure_message(false, "scenario::spill: ftruncate failed");
+			}
+			void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+			ensure(p != MAP_FAILED);
+			x = static_cast<double*>(p);
+		}
+		spill(const spill&) = delete;
+		spill& operator=(const spill&) = delete;
+		~spill()
+		{
+			::munmap(x, std::max<size_t>(1, M * N) * sizeof(double));
+		}
+
+		// Tiles are disjoint so no locking is needed.
+		void tile(const scenario::tile& t)
+		{
+			for (size_t i = t.i0; i < t.i1; ++i) {
+				std::memcpy(x + i * N + t.s0, t.row(i), t.width() * sizeof(double));
+			}
+		}
+		void end(size_t, size_t)
+		{ }
+
+		// Scenario PVs of instrument i.
+		const double* row(size_t i) const
+		{
+			return x + i * N;
+		}
+	};
+#endif // _WIN32
+
+#ifdef _DEBUG
+	inline int scenario_test()
+	{
+		{
+			p2 q(0.5);
+			assert(std::isnan(q.value()));
+			for (int i = 1; i <= 3; ++i) {
+				q.add(i);
+			}
+			assert(2 == q.value());
+		}
+		{
+			p2 q(0.9);
+			for (int i = 0; i < 10'000; ++i) {
+				q.add((i * 7919) % 10'000); // permutation of 0..9999
+			}
+			assert(std::fabs(q.value() - 9000) < 100);
+		}
+		{
+			const size_t M = 37, N = 1000;
+			const auto f = [](size_t i, size_t s) { return std::sin(0.1 * i + 0.01 * s) + 0.001 * i; };
+			const auto pv = [&f](size_t i0, size_t i1, size_t s0, size_t s1, double* out) {
+				for (size_t i = i0; i < i1; ++i) {
+					for (size_t s = s0; s < s1; ++s) {
+						*out++ = f(i, s);
+					}
+				}
+			};
+			std::vector<unsigned> g(M);
+			for (size_t i = 0; i < M; ++i) {
+				g[i] = i % 3;
+			}
+			aggregate a(M, g.data(), 3, 0.05);
+			options o;
+			o.budget = 4096; // force many small tiles
+			o.block = 64;
+			o.threads = 3;
+#ifndef _WIN32
+			const std::string path = (std::filesystem::temp_directory_path() / "tmx_scenario_test.bin").string();
+			{
+				spill sp(path, M, N);
+				run(M, N, pv, o, a, sp);
+				for (size_t i = 0; i < M; ++i) {
+					for (size_t s = 0; s < N; ++s) {
+						assert(sp.row(i)[s] == f(i, s));
+					}
+				}
+			}
+			std::filesystem::remove(path);
+#else
+			run(M, N, pv, o, a);
+#endif
+			assert(N == a.scenarios());
+			for (unsigned p = 0; p < 3; ++p) {
+				std::vector<double> tot(N, 0);
+				for (size_t i = p; i < M; i += 3) {
+					for (size_t s = 0; s < N; ++s) {
+						tot[s] += f(i, s);
+					}
+				}
+				double m = 0;
+				for (double x : tot) {
+					m += x;
+				}
+				m /= N;
+				assert(std::fabs(a.mean(p) - m) < 1e-9);
+				std::sort(tot.begin(), tot.end());
+				// sketch within a few ranks of the exact 5% quantile
+				const auto r = std::lower_bound(tot.begin(), tot.end(), a.quantile(p)) - tot.begin();
+				assert(std::abs(r - 50) < 20);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::scenario
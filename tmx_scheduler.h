@@ -0,0 +1,416 @@
+// tmx_scheduler.h - Work stealing thread pool with priority classes.
+// Each worker owns one deque per priority. Workers pop their own tasks LIFO
+// and steal from the front of other deques when idle, always taking the
+// highest priority task available anywhere before a lower one. Threads
+// waiting on a group run queued tasks and only sleep when there is nothing
+// to run, so nested waits cannot deadlock. Long batch work is run in chunks that requeue themselves,
+// so a high priority task waits for at most one chunk per worker.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <stdexcept>
+#endif // _DEBUG
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "tmx_parallel.h"
+
+namespace tmx::scheduler {
+
+	using task = std::function<void()>;
+
+	// Priority classes, most urgent first.
+	enum class priority : unsigned {
+		high,   // latency sensitive requests, e.g. quote driven yields
+		normal,
+		batch,  // risk runs and scenario chunks
+	};
+	constexpr unsigned priorities = 3;
+
+	class pool {
+		struct worker {
+			std::mutex m;
+			std::deque<task> q[priorities];
+		};
+		std::vector<std::unique_ptr<worker>> ws;
+		std::vector<std::thread> ts;
+		std::mutex m;
+		std::condition_variable cv;
+		std::atomic<size_t> pending = 0; // queued tasks
+		std::atomic<size_t> queued[priorities] = {}; // queued tasks by priority
+		std::atomic<size_t> next = 0; // round robin for external submits
+		bool stop = false;
+
+		// Worker index of the calling thread in this pool, or -1.
+		int self() const
+		{
+			return current_pool() == this ? current_index() : -1;
+		}
+		static const pool*& current_pool()
+		{
+			static thread_local const pool* p = nullptr;
+			return p;
+		}
+		static int& current_index()
+		{
+			static thread_local int i = -1;
+			return i;
+		}
+
+		bool pop(int i, unsigned p, task& t)
+		{
+			worker& w = *ws[i];
+			std::lock_guard lock(w.m);
+			if (w.q[p].empty()) {
+				return false;
+			}
+			t = std::move(w.q[p].back());
+			w.q[p].pop_back();
+
+			return true;
+		}
+		bool steal(int i, unsigned p, task& t)
+		{
+			worker& w = *ws[i];
+			std::lock_guard lock(w.m);
+			if (w.q[p].empty()) {
+				return false;
+			}
+			t = std::move(w.q[p].front());
+			w.q[p].pop_front();
+
+			return true;
+		}
+		void loop(int i)
+		{
+			current_pool() = this;
+			current_index() = i;
+			while (true) {
+				if (run_one()) {
+					continue;
+				}
+				std::unique_lock lock(m);
+				cv.wait(lock, [this] { return stop || pending > 0; });
+				if (stop && pending == 0) {
+					return;
+				}
+			}
+		}
+	public:
+		pool(unsigned p = parallel::concurrency())
+		{
+			p = std::max(p, 1u);
+			for (unsigned i = 0; i < p; ++i) {
+				ws.push_back(std::make_unique<worker>());
+			}
+			for (unsigned i = 0; i < p; ++i) {
+				ts.emplace_back([this, i] { loop(static_cast<int>(i)); });
+			}
+		}
+		pool(const pool&) = delete;
+		pool& operator=(const pool&) = delete;
+		~pool()
+		{
+			{
+				std::lock_guard lock(m);
+				stop = true;
+			}
+			cv.notify_all();
+			for (auto& t : ts) {
+				t.join();
+			}
+		}
+
+		size_t size() const
+		{
+			return ws.size();
+		}
+		// Tasks queued and not yet started.
+		size_t queued_tasks() const
+		{
+			return pending;
+		}
+
+		// Queue a task on the calling worker's deque or round robin from outside the pool.
+		void submit(task t, priority p = priority::normal)
+		{
+			const unsigned k = static_cast<unsigned>(p);
+			int i = self();
+			if (i < 0) {
+				i = static_cast<int>(next++ % ws.size());
+			}
+			{
+				std::lock_guard lock(m);
+				++pending;
+				++queued[k];
+			}
+			{
+				std::lock_guard lock(ws[i]->m);
+				ws[i]->q[k].push_back(std::move(t));
+			}
+			cv.notify_one();
+		}
+
+		// Run one queued task if any. For each priority, own deque first, then steal.
+		bool run_one()
+		{
+			const int i = self();
+			const int n = static_cast<int>(ws.size());
+			task t;
+			for (unsigned p = 0; p < priorities; ++p) {
+				if (queued[p] == 0) {
+					continue;
+				}
+				bool found = i >= 0 && pop(i, p, t);
+				for (int k = 1; !found && k <= n; ++k) {
+					found = steal((std::max(i, 0) + k) % n, p, t);
+				}
+				if (found) {
+					--queued[p];
+					--pending;
+					t();
+
+					return true;
+				}
+			}
+
+			return false;
+		}
+	};
+
+	// Tasks that can be waited on together. The first exception thrown by a task is
+	// rethrown by wait after every task has finished.
+	class group {
+		pool& p;
+		std::mutex m;
+		std::condition_variable cv;
+		size_t n = 0; // tasks not finished
+		std::exception_ptr error;
+
+		// Help run tasks, sleeping on the group when there is nothing to run, until n is 0.
+		// Every return holds the lock once after the last task released it.
+		void join()
+		{
+			while (true) {
+				{
+					std::lock_guard lock(m);
+					if (n == 0) {
+						return;
+					}
+				}
+				if (p.run_one()) {
+					continue;
+				}
+				std::unique_lock lock(m);
+				if (cv.wait_for(lock, std::chrono::milliseconds(1), [this] { return n == 0; })) {
+					return;
+				}
+			}
+		}
+	public:
+		group(pool& p)
+			: p(p)
+		{ }
+		group(const group&) = delete;
+		group& operator=(const group&) = delete;
+		~group()
+		{
+			join();
+		}
+
+		void run(task t, priority q = priority::normal)
+		{
+			{
+				std::lock_guard lock(m);
+				++n;
+			}
+			p.submit([this, t = std::move(t)] {
+				// finish even if t throws
+				struct finish {
+					group& g;
+					~finish()
+					{
+						std::lock_guard lock(g.m);
+						if (--g.n == 0) {
+							g.cv.notify_all();
+						}
+					}
+				} f{ *this };
+				try {
+					t();
+				}
+				catch (...) {
+					std::lock_guard lock(m);
+					if (!error) {
+						error = std::current_exception();
+					}
+				}
+			}, q);
+		}
+
+		// Call f(b, e) on chunks of at most grain items covering [0, n_) using up to lanes tasks.
+		// Each lane requeues itself after every chunk so more urgent tasks can run in between.
+		template<class F>
+		void run_chunks(size_t n_, size_t grain, const F& f, priority q = priority::batch, unsigned lanes = 0)
+		{
+			if (n_ == 0) {
+				return;
+			}
+			grain = std::max<size_t>(grain, 1);
+			lanes = lanes ? lanes : static_cast<unsigned>(p.size());
+			lanes = static_cast<unsigned>(std::min<size_t>(lanes, (n_ + grain - 1) / grain));
+
+			auto next_ = std::make_shared<std::atomic<size_t>>(0);
+			auto f_ = std::make_shared<const F>(f);
+			for (unsigned l = 0; l < lanes; ++l) {
+				lane(next_, f_, n_, grain, q);
+			}
+		}
+	private:
+		template<class F>
+		void lane(std::shared_ptr<std::atomic<size_t>> next_, std::shared_ptr<const F> f, size_t n_, size_t grain, priority q)
+		{
+			run([this, next_, f, n_, grain, q] {
+				const size_t b = next_->fetch_add(grain);
+				if (b < n_) {
+					(*f)(b, std::min(b + grain, n_));
+					if (b + grain < n_) {
+						lane(next_, f, n_, grain, q);
+					}
+				}
+			}, q);
+		}
+	public:
+		// Help run tasks until every task in the group has finished.
+		// Rethrow the first exception thrown by a task since the last wait.
+		void wait()
+		{
+			join();
+			std::exception_ptr e;
+			{
+				std::lock_guard lock(m);
+				std::swap(e, error);
+			}
+			if (e) {
+				std::rethrow_exception(e);
+			}
+		}
+	};
+
+#ifdef _DEBUG
+	inline int pool_test()
+	{
+		{
+			pool p(4);
+			assert(4 == p.size());
+			std::atomic<int> n = 0;
+			{
+				group g(p);
+				for (int i = 0; i < 100; ++i) {
+					g.run([&n] { ++n; });
+				}
+				g.wait();
+			}
+			assert(100 == n);
+		}
+		{
+			// nested groups
+			pool p(2);
+			std::atomic<int> n = 0;
+			group g(p);
+			for (int i = 0; i < 10; ++i) {
+				g.run([&p, &n] {
+					group h(p);
+					for (int j = 0; j < 10; ++j) {
+						h.run([&n] { ++n; });
+					}
+					h.wait();
+				});
+			}
+			g.wait();
+			assert(100 == n);
+		}
+		{
+			// high priority work runs ahead of queued batch chunks, the only
+			// worker is held by a gate task until all work is queued
+			pool p(1);
+			std::atomic<bool> go = false;
+			std::atomic<size_t> done = 0;
+			std::vector<int> order;
+			group g(p);
+			g.run([&go] {
+				while (!go) {
+					std::this_thread::yield();
+				}
+			});
+			while (p.queued_tasks() != 0) {
+				std::this_thread::yield();
+			}
+			g.run_chunks(10, 1, [&](size_t, size_t) {
+				order.push_back(0);
+				++done;
+			});
+			g.run([&] {
+				order.push_back(1);
+				++done;
+			}, priority::high);
+			go = true;
+			while (done < 11) {
+				std::this_thread::yield();
+			}
+			g.wait();
+			assert(11 == order.size());
+			assert(1 == order[0]);
+		}
+		{
+			// a throwing task still finishes and wait rethrows once
+			pool p(2);
+			std::atomic<int> n = 0;
+			group g(p);
+			for (int i = 0; i < 20; ++i) {
+				g.run([&n, i] {
+					if (i == 7) {
+						throw std::runtime_error("task 7");
+					}
+					++n;
+				});
+			}
+			bool thrown = false;
+			try {
+				g.wait();
+			}
+			catch (const std::runtime_error&) {
+				thrown = true;
+			}
+			assert(thrown);
+			assert(19 == n);
+			g.wait();
+		}
+		{
+			// chunks cover the range exactly once
+			pool p(3);
+			std::vector<std::atomic<int>> v(1001);
+			group g(p);
+			g.run_chunks(v.size(), 7, [&v](size_t b, size_t e) {
+				for (size_t i = b; i < e; ++i) {
+					++v[i];
+				}
+			}, priority::normal);
+			g.wait();
+			for (const auto& x : v) {
+				assert(1 == x);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::scheduler
@@ -0,0 +1,488 @@
+// tmx_shm.h - Portfolio and curves shared between processes.
+// One process creates a POSIX shared memory segment holding a columnar
+// portfolio (flow offsets, times, cash) and a fixed number of versioned
+// piecewise flat curve slots. Other processes attach: the control page with
+// the work queue is mapped read-write, everything else read-only.
+//
+//   page 0   header and work queue (read-write)
+//   page 1.. curve slots | start[m + 1] | u[flows] | c[flows] (read-only for readers)
+//
+// Curve slots are guarded by sequence locks so readers never block the
+// publisher. The work queue hands out chunk numbers with compare and swap.
+// The header magic is stored last so readers never attach to a segment that
+// is still being filled.
+#pragma once
+#ifndef _WIN32
+#ifdef _DEBUG
+#include <cassert>
+#include <thread>
+#endif // _DEBUG
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ensure.h"
+#include "tmx_curve_handle.h"
+#include "tmx_curve_pwflat.h"
+
+namespace tmx::shm {
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+	constexpr uint64_t magic = 0x746d785f73686d31ull; // "tmx_shm1"
+	constexpr size_t page = 4096;
+
+	// Work queue of chunk numbers shared by all attached processes.
+	// The job epoch is packed with the next chunk and with the finished count so a
+	// claim or finish from a job that has been reset never touches the current one.
+	struct queue {
+		std::atomic<uint64_t> state; // epoch << 32 | next chunk to hand out
+		std::atomic<uint64_t> total; // chunks in current job
+		std::atomic<uint64_t> done;  // epoch << 32 | chunks finished
+
+		static constexpr uint64_t closed = UINT32_MAX; // next chunk while resetting
+
+		static uint32_t epoch(uint64_t x)
+		{
+			return static_cast<uint32_t>(x >> 32);
+		}
+		static uint64_t low(uint64_t x)
+		{
+			return x & UINT32_MAX;
+		}
+
+		// Start a job of n chunks. Return its epoch.
+		uint32_t reset(uint64_t n)
+		{
+			ensure(n < closed);
+
+			uint32_t e = epoch(state.load(std::memory_order_relaxed)) + 1;
+			if (e == 0) {
+				e = 1; // 0 is never a job
+			}
+			state.store(uint64_t(e) << 32 | closed, std::memory_order_release); // no takers while resetting
+			total.store(n, std::memory_order_release);
+			done.store(uint64_t(e) << 32, std::memory_order_release);
+			state.store(uint64_t(e) << 32, std::memory_order_release);
+
+			return e;
+		}
+		// Claim the next chunk k and return the epoch of its job, or 0 when none are left.
+		// The exchange fails if a reset started after state was read, so k always belongs
+		// to the returned epoch and is below its total.
+		uint32_t take(uint64_t& k)
+		{
+			uint64_t s = state.load(std::memory_order_acquire);
+			do {
+				k = low(s);
+				if (k == closed || k >= total.load(std::memory_order_acquire)) {
+					return 0;
+				}
+			} while (!state.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+
+			return epoch(s);
+		}
+		// Mark a chunk claimed under epoch e finished. Chunks of earlier jobs are ignored.
+		void finish(uint32_t e)
+		{
+			uint64_t d = done.load(std::memory_order_acquire);
+			do {
+				if (epoch(d) != e) {
+					return;
+				}
+			} while (!done.compare_exchange_weak(d, d + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+		}
+		bool finished() const
+		{
+			return low(done.load(std::memory_order_acquire)) >= total.load(std::memory_order_acquire);
+		}
+	};
+
+	struct header {
+		std::atomic<uint64_t> magic; // stored last, readers attach only to complete segments
+		uint64_t size;      // segment bytes
+		uint64_t m;         // instruments
+		uint64_t flows;
+		uint32_t curves;    // curve slots
+		uint32_t knots;     // capacity of each slot
+		uint64_t curve_off; // byte offsets from segment start
+		uint64_t start_off;
+		uint64_t u_off;
+		uint64_t c_off;
+		queue q;
+	};
+	static_assert(sizeof(header) <= page);
+
+	// Curve slot followed by t[knots] and f[knots].
+	struct slot {
+		std::atomic<uint64_t> seq; // odd while being written
+		uint64_t version;
+		uint64_t n;
+		double _f;
+
+		static size_t bytes(uint32_t knots)
+		{
+			return sizeof(slot) + 2 * knots * sizeof(double);
+		}
+		double* t()
+		{
+			return reinterpret_cast<double*>(this + 1);
+		}
+		const double* t() const
+		{
+			return reinterpret_cast<const double*>(this + 1);
+		}
+		double* f(uint32_t knots)
+		{
+			return t() + knots;
+		}
+		const double* f(uint32_t knots) const
+		{
+			return t() + knots;
+		}
+	};
+
+	inline size_t round_up(size_t n, size_t a = page)
+	{
+		return (n + a - 1) / a * a;
+	}
+
+	// Creates, owns and unlinks the segment.
+	class publisher {
+		std::string name;
+		header* h = nullptr;
+		char* base = nullptr;
+
+		slot& at(uint32_t k)
+		{
+			return *reinterpret_cast<slot*>(base + h->curve_off + k * slot::bytes(h->knots));
+		}
+	public:
+		// Instrument i has flows start[i] <= j < start[i + 1] with times u[j] and cash c[j].
+		publisher(const std::string& name, size_t m, const uint64_t* start, const double* u, const double* c,
+			uint32_t curves = 1, uint32_t knots = 64)
+			: name(name)
+		{
+			const uint64_t flows = start[m];
+			const size_t curve_off = page;
+			const size_t start_off = curve_off + round_up(curves * slot::bytes(knots), 64);
+			const size_t u_off = start_off + round_up((m + 1) * sizeof(uint64_t), 64);
+			const size_t c_off = u_off + round_up(flows * sizeof(double), 64);
+			const size_t size = round_up(c_off + flows * sizeof(double));
+
+			const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			ensure_message(fd >= 0, "shm::publisher: shm_open failed for " + name);
+			if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+				::close(fd);
+				::shm_unlink(name.c_str());
+				ensure_message(false, "shm::publisher: ftruncate failed");
+			}
+			void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (p == MAP_FAILED) {
+				::shm_unlink(name.c_str());
+				ensure_message(false, "shm::publisher: mmap failed");
+			}
+
+			base = static_cast<char*>(p);
+			h = new (base) header{ {0}, size, m, flows, curves, knots, curve_off, start_off, u_off, c_off, {} };
+			for (uint32_t k = 0; k < curves; ++k) {
+				new (&at(k)) slot{ {0}, 0, 0, 0 };
+			}
+			std::memcpy(base + start_off, start, (m + 1) * sizeof(uint64_t));
+			std::memcpy(base + u_off, u, flows * sizeof(double));
+			std::memcpy(base + c_off, c, flows * sizeof(double));
+			h->magic.store(magic, std::memory_order_release);
+		}
+		publisher(const publisher&) = delete;
+		publisher& operator=(const publisher&) = delete;
+		~publisher()
+		{
+			::munmap(base, h->size);
+			::shm_unlink(name.c_str());
+		}
+
+		// Write curve slot k and return its new version.
+		uint64_t publish(uint32_t k, size_t n, const double* t, const double* f, double _f)
+		{
+			ensure(k < h->curves);
+			ensure(n <= h->knots);
+
+			slot& s = at(k);
+			const uint64_t v = curve::next_version();
+			const uint64_t s0 = s.seq.load(std::memory_order_relaxed);
+			s.seq.store(s0 + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			s.version = v;
+			s.n = n;
+			s._f = _f;
+			std::memcpy(s.t(), t, n * sizeof(double));
+			std::memcpy(s.f(h->knots), f, n * sizeof(double));
+			s.seq.store(s0 + 2, std::memory_order_release);
+
+			return v;
+		}
+
+		shm::queue& queue()
+		{
+			return h->q;
+		}
+	};
+
+	// Owned file descriptor, closed on destruction.
+	class descriptor {
+		int fd;
+	public:
+		explicit descriptor(int fd)
+			: fd(fd)
+		{ }
+		descriptor(const descriptor&) = delete;
+		descriptor& operator=(const descriptor&) = delete;
+		~descriptor()
+		{
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
+		operator int() const
+		{
+			return fd;
+		}
+	};
+
+	// Owned shared mapping, unmapped on destruction.
+	class mapping {
+		void* p = MAP_FAILED;
+		size_t n = 0;
+	public:
+		mapping() = default;
+		mapping(int fd, size_t n, int prot)
+			: p(::mmap(nullptr, n, prot, MAP_SHARED, fd, 0)), n(n)
+		{ }
+		mapping(const mapping&) = delete;
+		mapping& operator=(const mapping&) = delete;
+		mapping& operator=(mapping&& m) noexcept
+		{
+			std::swap(p, m.p);
+			std::swap(n, m.n);
+
+			return *this;
+		}
+		~mapping()
+		{
+			if (p != MAP_FAILED) {
+				::munmap(p, n);
+			}
+		}
+		explicit operator bool() const
+		{
+			return p != MAP_FAILED;
+		}
+		void* data() const
+		{
+			return p;
+		}
+	};
+
+	// Attaches to a published segment.
+	class reader {
+		mapping ro; // read-only mapping of whole segment
+		mapping rw; // read-write mapping of page 0
+		const header* h = nullptr;
+		header* control = nullptr;
+		const char* base = nullptr;
+	public:
+		reader(const std::string& name)
+		{
+			const descriptor fd(::shm_open(name.c_str(), O_RDWR, 0));
+			ensure_message(fd >= 0, "shm::reader: shm_open failed for " + name);
+			struct stat st;
+			ensure_message(::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(page), "shm::reader: bad segment " + name);
+			const size_t size = static_cast<size_t>(st.st_size);
+			ro = mapping(fd, size, PROT_READ);
+			rw = mapping(fd, page, PROT_READ | PROT_WRITE);
+			ensure(ro && rw);
+
+			base = static_cast<const char*>(ro.data());
+			h = reinterpret_cast<const header*>(base);
+			control = static_cast<header*>(rw.data());
+			ensure_message(h->magic.load(std::memory_order_acquire) == magic && h->size == size, "shm::reader: not a tmx segment");
+		}
+		reader(const reader&) = delete;
+		reader& operator=(const reader&) = delete;
+
+		size_t size_instruments() const
+		{
+			return h->m;
+		}
+		size_t size_flows() const
+		{
+			return h->flows;
+		}
+		uint32_t curves() const
+		{
+			return h->curves;
+		}
+
+		// Times and cash flows of instrument i.
+		std::span<const double> time(size_t i) const
+		{
+			const uint64_t* s = reinterpret_cast<const uint64_t*>(base + h->start_off);
+			return { reinterpret_cast<const double*>(base + h->u_off) + s[i], s[i + 1] - s[i] };
+		}
+		std::span<const double> cash(size_t i) const
+		{
+			const uint64_t* s = reinterpret_cast<const uint64_t*>(base + h->start_off);
+			return { reinterpret_cast<const double*>(base + h->c_off) + s[i], s[i + 1] - s[i] };
+		}
+
+		// Version of curve slot k, 0 if never published.
+		uint64_t version(uint32_t k) const
+		{
+			const slot& s = *reinterpret_cast<const slot*>(base + h->curve_off + k * slot::bytes(h->knots));
+			while (true) {
+				const uint64_t s0 = s.seq.load(std::memory_order_acquire);
+				const uint64_t v = s.version;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (!(s0 & 1) && s.seq.load(std::memory_order_relaxed) == s0) {
+					return v;
+				}
+			}
+		}
+		// Consistent copy of curve slot k and its version.
+		std::pair<curve::pwflat<>, uint64_t> curve(uint32_t k) const
+		{
+			ensure(k < h->curves);
+
+			const slot& s = *reinterpret_cast<const slot*>(base + h->curve_off + k * slot::bytes(h->knots));
+			std::vector<double> t(h->knots), f(h->knots);
+			while (true) {
+				const uint64_t s0 = s.seq.load(std::memory_order_acquire);
+				if (s0 & 1) {
+					continue;
+				}
+				const uint64_t v = s.version;
+				const size_t n = std::min<uint64_t>(s.n, h->knots);
+				const double _f = s._f;
+				std::memcpy(t.data(), s.t(), n * sizeof(double));
+				std::memcpy(f.data(), s.f(h->knots), n * sizeof(double));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (s.seq.load(std::memory_order_relaxed) == s0) {
+					return { curve::pwflat<>(n, t.data(), f.data(), _f), v };
+				}
+			}
+		}
+
+		shm::queue& queue()
+		{
+			return control->q;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int shm_test()
+	{
+		const std::string name = "/tmx_shm_test_" + std::to_string(::getpid());
+		const uint64_t start[] = { 0, 2, 5 };
+		const double u[] = { 1, 2, 1, 2, 3 };
+		const double c[] = { 0.05, 1.05, 0.04, 0.04, 1.04 };
+		{
+			publisher p(name, 2, start, u, c, 2, 8);
+			reader r(name);
+			assert(2 == r.size_instruments());
+			assert(5 == r.size_flows());
+			assert(2 == r.curves());
+			assert(3 == r.time(1).size() && 3 == r.time(1)[2] && 1.04 == r.cash(1)[2]);
+			assert(0 == r.version(0));
+
+			const double t[] = { 1, 2, 3 };
+			const double f[] = { 0.03, 0.04, 0.05 };
+			const uint64_t v = p.publish(0, 3, t, f, 0.05);
+			assert(v == r.version(0));
+			auto [g, v_] = r.curve(0);
+			assert(v == v_);
+			curve::pwflat<> g_(3, t, f, 0.05);
+			for (size_t j = 0; j < 3; ++j) {
+				assert(g.discount(r.time(1)[j]) == g_.discount(u[2 + j]));
+			}
+
+			// chunks shared between attached readers
+			p.queue().reset(1000);
+			reader r2(name);
+			std::atomic<uint64_t> sum = 0;
+			std::thread t1([&r, &sum] {
+				uint64_t k;
+				while (const uint32_t e = r.queue().take(k)) {
+					sum += k;
+					r.queue().finish(e);
+				}
+			});
+			uint64_t k;
+			while (const uint32_t e = r2.queue().take(k)) {
+				sum += k;
+				r2.queue().finish(e);
+			}
+			t1.join();
+			assert(p.queue().finished());
+			assert(999 * 1000 / 2 == sum);
+
+			// exhausted queue hands out nothing until the next job, which starts at chunk 0
+			assert(0 == r.queue().take(k));
+			const uint32_t e0 = p.queue().reset(3);
+			assert(e0 == r2.queue().take(k) && 0 == k);
+
+			// a chunk claimed before a reset finishing after it does not count for the new job
+			const uint32_t e1 = p.queue().reset(2);
+			assert(e1 != e0);
+			r.queue().finish(e0);
+			assert(!p.queue().finished());
+			for (uint64_t i = 0; i < 2; ++i) {
+				const uint32_t e = r2.queue().take(k);
+				assert(e1 == e && i == k);
+				assert(!p.queue().finished());
+				r2.queue().finish(e);
+			}
+			assert(p.queue().finished());
+			assert(0 == r.queue().take(k));
+		}
+		{
+			// segment without a header is rejected
+			const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			assert(fd >= 0);
+			const int rc = ::ftruncate(fd, page);
+			assert(0 == rc);
+			::close(fd);
+			bool thrown = false;
+			try {
+				reader r(name);
+			}
+			catch (const std::exception&) {
+				thrown = true;
+			}
+			assert(thrown);
+			::shm_unlink(name.c_str());
+		}
+		{
+			// unlinked by publisher
+			bool thrown = false;
+			try {
+				reader r(name);
+			}
+			catch (const std::exception&) {
+				thrown = true;
+			}
+			assert(thrown);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::shm
+#endif // _WIN32
@@ -66,6 +66,51 @@ namespace tmx::value {
 		return cnv;
 	}
 
+	// Present value at t of cash flows c[j] at times u[j] > t.
+	template<class U, class C, class T, class F>
+	constexpr C present(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t = 0)
+	{
+		C pv = 0;
+
+		for (size_t j = 0; j < m; ++j) {
+			if (u[j] > t) {
+				pv += c[j] * f.discount(u[j], t);
+			}
+		}
+
+		return pv;
+	}
+
+	// Derivative of present value with respect to a parallel shift.
+	template<class U, class C, class T, class F>
+	constexpr C duration(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t = 0)
+	{
+		C dur = 0;
+
+		for (size_t j = 0; j < m; ++j) {
+			if (u[j] > t) {
+				dur -= (u[j] - t) * c[j] * f.discount(u[j], t);
+			}
+		}
+
+		return dur;
+	}
+
+	// Second derivative of present value with respect to a parallel shift.
+	template<class U, class C, class T, class F>
+	constexpr C convexity(size_t m, const U* u, const C* c, const curve::base<T, F>& f, T t = 0)
+	{
+		C cnv = 0;
+
+		for (size_t j = 0; j < m; ++j) {
+			if (u[j] > t) {
+				cnv += (u[j] - t) * (u[j] - t) * c[j] * f.discount(u[j], t);
+			}
+		}
+
+		return cnv;
+	}
+
 	// Constant forward rate matching price p at t.
 	template<class U, class C>
 	inline C yield(instrument::base<U, C>& i, const C p = 0, U t = 0,
@@ -1,5 +1,8 @@
 // tmx_variate.h - Random variates.
 #pragma once
+#include <cmath>
+#include <limits>
+#include "tmx_variate_stream.h"
 
 namespace tmx::variate {
 
@@ -29,11 +32,50 @@ namespace tmx::variate {
 		{
 			return _mgf(s);
 		}
+		// Inverse distribution function, cdf(inv(u)) = u.
+		X inv(X u) const
+		{
+			return _inv(u);
+		}
+		// Fill x with n samples drawn from g.
+		void sample(size_t n, X* x, stream& g) const
+		{
+			_sample(n, x, g);
+		}
 	private:
 		virtual X _pdf(X x, S s) const = 0;
 		virtual X _cdf(X x, S s) const = 0;
 		virtual S _cgf(S s) const = 0;
 		virtual S _mgf(S s) const = 0;
+
+		// Bisection on cdf unless overridden.
+		virtual X _inv(X u) const
+		{
+			if (!(0 < u && u < 1)) {
+				return u == 0 ? -std::numeric_limits<X>::infinity()
+				     : u == 1 ? std::numeric_limits<X>::infinity() : std::numeric_limits<X>::quiet_NaN();
+			}
+			X a = -1, b = 1;
+			while (cdf(a) > u) {
+				a *= 2;
+			}
+			while (cdf(b) < u) {
+				b *= 2;
+			}
+			for (int i = 0; i < 200 && b - a > std::numeric_limits<X>::epsilon() * (1 + std::fabs(a)); ++i) {
+				const X m = (a + b) / 2;
+				(cdf(m) < u ? a : b) = m;
+			}
+
+			return (a + b) / 2;
+		}
+		// Inverse transform sampling unless overridden.
+		virtual void _sample(size_t n, X* x, stream& g) const
+		{
+			for (size_t i = 0; i < n; ++i) {
+				x[i] = _inv(static_cast<X>(g.uniform()));
+			}
+		}
 	};
 
 } // namespace tms::variate
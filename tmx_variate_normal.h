@@ -2,8 +2,12 @@
 #pragma once
 #ifdef _DEBUG
 #include <cassert>
+#include <vector>
 #endif // _DEBUG
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <numbers>
 #include "tmx_variate.h"
 
@@ -40,9 +44,161 @@ namespace tmx::variate {
 		{
 			return std::exp(s * s / 2);
 		}
+
+		// Acklam's rational approximation refined by one Halley step on erfc.
+		X _inv(X u) const override
+		{
+			X x;
+			inv(1, &u, &x);
+
+			return x;
+		}
+
+		// Ziggurat
+		void _sample(size_t n, X* x, stream& g) const override
+		{
+			ziggurat(n, x, g);
+		}
+
+		using base<X, S>::inv;
+		using base<X, S>::sample;
+
+		// Batch x[i] = inv(u[i]), e.g. for quasi random points. x may be u.
+		// Loops without branches go first so they vectorize; tails are fixed up after.
+		static void inv(size_t n, const X* u, X* x)
+		{
+			constexpr size_t B = 256;
+			if (n > B || u == x) {
+				X u_[B];
+				for (size_t b = 0; b < n; b += B) {
+					const size_t m = std::min(B, n - b);
+					std::copy(u + b, u + b + m, u_);
+					inv(m, u_, x + b);
+				}
+				return;
+			}
+
+			static constexpr X a[] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+			                           1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+			static constexpr X b[] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+			                           6.680131188771972e+01, -1.328068155288572e+01 };
+			static constexpr X c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+			                           -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+			static constexpr X d[] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+			                           3.754408661907416e+00 };
+			constexpr X lo = X(0.02425), hi = 1 - lo;
+
+			// central region
+			for (size_t i = 0; i < n; ++i) {
+				const X q = u[i] - X(0.5);
+				const X r = q * q;
+				x[i] = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q
+				     / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+			}
+			// tails
+			for (size_t i = 0; i < n; ++i) {
+				if (!(lo <= u[i] && u[i] <= hi)) {
+					if (0 < u[i] && u[i] < 1) {
+						const X q = std::sqrt(-2 * std::log(u[i] < lo ? u[i] : 1 - u[i]));
+						const X y = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+						          / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+						x[i] = u[i] < lo ? y : -y;
+					}
+					else {
+						x[i] = u[i] == 0 ? -std::numeric_limits<X>::infinity()
+						     : u[i] == 1 ? std::numeric_limits<X>::infinity() : std::numeric_limits<X>::quiet_NaN();
+					}
+				}
+			}
+			// Halley refinement
+			const X sqrt2pi = std::sqrt(2 * std::numbers::pi_v<X>);
+			for (size_t i = 0; i < n; ++i) {
+				const X e = std::erfc(-x[i] / std::numbers::sqrt2_v<X>) / 2 - u[i];
+				const X v = e * sqrt2pi * std::exp(x[i] * x[i] / 2);
+				const X x_ = x[i] - v / (1 + x[i] * v / 2);
+				x[i] = std::isfinite(x_) ? x_ : x[i];
+			}
+		}
+
+		// Fill x with standard normals using the 128 layer ziggurat of Marsaglia and Tsang
+		// in Doornik's form. Blocks of draws are tested against the rectangles without
+		// branches and only rejected draws take the wedge or tail path.
+		static void ziggurat(size_t n, X* x, stream& g)
+		{
+			static constexpr int C = 128;
+			static constexpr double R = 3.442619855899;
+			static constexpr double V = 9.91256303526217e-3;
+			struct table {
+				double x[C + 1], r[C];
+				table()
+				{
+					const double f = std::exp(-R * R / 2);
+					x[0] = V / f;
+					x[1] = R;
+					x[C] = 0;
+					for (int i = 2; i < C; ++i) {
+						x[i] = std::sqrt(-2 * std::log(V / x[i - 1] + std::exp(-x[i - 1] * x[i - 1] / 2)));
+					}
+					for (int i = 0; i < C; ++i) {
+						r[i] = x[i + 1] / x[i];
+					}
+				}
+			};
+			static const table t;
+
+			constexpr size_t B = 256;
+			uint64_t w[B];
+			bool ok[B];
+			for (size_t b = 0; b < n; b += B) {
+				const size_t m = std::min(B, n - b);
+				for (size_t i = 0; i < m; ++i) {
+					w[i] = g();
+				}
+				for (size_t i = 0; i < m; ++i) {
+					const int k = static_cast<int>(w[i] & (C - 1));
+					const double u = 2 * (static_cast<double>(w[i] >> 11) * 0x1.0p-53) - 1;
+					x[b + i] = static_cast<X>(u * t.x[k]);
+					ok[i] = std::fabs(u) < t.r[k];
+				}
+				for (size_t i = 0; i < m; ++i) {
+					if (ok[i]) {
+						continue;
+					}
+					int k = static_cast<int>(w[i] & (C - 1));
+					double u = 2 * (static_cast<double>(w[i] >> 11) * 0x1.0p-53) - 1;
+					while (true) {
+						if (k == 0) {
+							// tail beyond R
+							double a, y;
+							do {
+								a = -std::log(g.uniform()) / R;
+								y = -std::log(g.uniform());
+							} while (y + y < a * a);
+							x[b + i] = static_cast<X>(u < 0 ? -(R + a) : R + a);
+							break;
+						}
+						const double z = u * t.x[k];
+						const double f0 = std::exp(-(t.x[k] * t.x[k] - z * z) / 2);
+						const double f1 = std::exp(-(t.x[k + 1] * t.x[k + 1] - z * z) / 2);
+						if (f1 + g.uniform() * (f0 - f1) < 1) {
+							x[b + i] = static_cast<X>(z);
+							break;
+						}
+						const uint64_t v = g();
+						k = static_cast<int>(v & (C - 1));
+						u = 2 * (static_cast<double>(v >> 11) * 0x1.0p-53) - 1;
+						if (std::fabs(u) < t.r[k]) {
+							x[b + i] = static_cast<X>(u * t.x[k]);
+							break;
+						}
+					}
+				}
+			}
+		}
 #ifdef _DEBUG
 		static int test()
 		{
+			const normal<> n_;
 			{
 				normal<> n;
 				assert(n.pdf(0) == 1 / std::sqrt(2 * std::numbers::pi));
@@ -56,6 +212,73 @@ namespace tmx::variate {
 				assert(b.cgf(0) == 0);
 				assert(b.mgf(0) == 1);
 			}
+			{
+				// inverse
+				double u[] = { 1e-300, 1e-10, 0.001, 0.02425, 0.1, 0.5, 0.7, 0.975, 1 - 1e-10, 0, 1 };
+				double x[11];
+				normal<>::inv(11, u, x);
+				for (size_t i = 0; i < 9; ++i) {
+					assert(std::fabs(std::erfc(-x[i] / std::numbers::sqrt2) / 2 - u[i]) <= 1e-12 * u[i]);
+					assert(x[i] == n_.inv(u[i]));
+				}
+				assert(std::isinf(x[9]) && x[9] < 0);
+				assert(std::isinf(x[10]) && x[10] > 0);
+				normal<>::inv(11, u, u); // in place
+				assert(u[5] == 0 && u[3] == x[3]);
+			}
+			{
+				// samplers through the base interface
+				const base<>& b = n_;
+				stream g(42);
+				const size_t N = 1'000'000;
+				std::vector<double> x(N);
+				b.sample(N, x.data(), g);
+				double m = 0, v = 0, tail = 0;
+				for (double xi : x) {
+					m += xi;
+					v += xi * xi;
+					tail += xi < -1.96;
+				}
+				m /= N;
+				v = v / N - m * m;
+				assert(std::fabs(m) < 0.005);
+				assert(std::fabs(v - 1) < 0.005);
+				assert(std::fabs(tail / N - 0.025) < 0.001);
+
+				// same seed, same samples
+				stream g2(42);
+				std::vector<double> y(N);
+				normal<>::ziggurat(N, y.data(), g2);
+				assert(x == y);
+			}
+			{
+				// other variates get inverse transform sampling from the base
+				struct uniform : public base<> {
+					double _pdf(double x, double) const override
+					{
+						return std::fabs(x) < std::sqrt(3.) ? 1 / (2 * std::sqrt(3.)) : 0;
+					}
+					double _cdf(double x, double) const override
+					{
+						return std::clamp((x + std::sqrt(3.)) / (2 * std::sqrt(3.)), 0., 1.);
+					}
+					double _cgf(double s) const override
+					{
+						return std::log(_mgf(s));
+					}
+					double _mgf(double s) const override
+					{
+						return s == 0 ? 1 : std::sinh(std::sqrt(3.) * s) / (std::sqrt(3.) * s);
+					}
+				} uni;
+				assert(std::fabs(uni.inv(0.75) - std::sqrt(3.) / 2) < 1e-12);
+				stream g(3);
+				double x[1000];
+				uni.sample(1000, x, g);
+				for (double xi : x) {
+					assert(std::fabs(xi) < std::sqrt(3.));
+				}
+			}
 
 			return 0;
 		}
@@ -0,0 +1,120 @@
+// tmx_variate_stream.h - Seedable uniform random number streams.
+// xoshiro256++ seeded by splitmix64. Streams with the same seed and different
+// ids are independent for practical purposes; jump() advances 2^128 draws for
+// provably disjoint substreams.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include <cmath>
+#endif // _DEBUG
+#include <cstdint>
+
+namespace tmx::variate {
+
+	inline uint64_t splitmix64(uint64_t& x)
+	{
+		uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+
+		return z ^ (z >> 31);
+	}
+
+	class stream {
+		uint64_t s[4];
+
+		static uint64_t rotl(uint64_t x, int k)
+		{
+			return (x << k) | (x >> (64 - k));
+		}
+	public:
+		stream(uint64_t seed = 0, uint64_t id = 0)
+		{
+			uint64_t x = seed;
+			uint64_t y = id;
+			x ^= splitmix64(y);
+			for (auto& si : s) {
+				si = splitmix64(x);
+			}
+		}
+
+		// Next 64 random bits.
+		uint64_t operator()()
+		{
+			const uint64_t r = rotl(s[0] + s[3], 23) + s[0];
+			const uint64_t t = s[1] << 17;
+			s[2] ^= s[0];
+			s[3] ^= s[1];
+			s[1] ^= s[2];
+			s[0] ^= s[3];
+			s[2] ^= t;
+			s[3] = rotl(s[3], 45);
+
+			return r;
+		}
+
+		// Uniform on (0, 1) from the top 53 bits.
+		double uniform()
+		{
+			return (static_cast<double>((*this)() >> 11) + 0.5) * 0x1.0p-53;
+		}
+		void uniform(size_t n, double* u)
+		{
+			for (size_t i = 0; i < n; ++i) {
+				u[i] = uniform();
+			}
+		}
+
+		// Advance 2^128 draws.
+		void jump()
+		{
+			static constexpr uint64_t J[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+			uint64_t t[4] = { 0, 0, 0, 0 };
+			for (uint64_t j : J) {
+				for (int b = 0; b < 64; ++b) {
+					if (j & (uint64_t(1) << b)) {
+						for (int i = 0; i < 4; ++i) {
+							t[i] ^= s[i];
+						}
+					}
+					(*this)();
+				}
+			}
+			for (int i = 0; i < 4; ++i) {
+				s[i] = t[i];
+			}
+		}
+
+#ifdef _DEBUG
+		static int test()
+		{
+			{
+				stream a(42), b(42), c(42, 1);
+				for (int i = 0; i < 100; ++i) {
+					const uint64_t x = a();
+					assert(x == b());
+					assert(x != c());
+				}
+			}
+			{
+				stream a(7);
+				double m = 0;
+				for (int i = 0; i < 100'000; ++i) {
+					const double u = a.uniform();
+					assert(0 < u && u < 1);
+					m += u;
+				}
+				assert(std::abs(m / 100'000 - 0.5) < 0.01);
+			}
+			{
+				stream a(1), b(1);
+				b.jump();
+				assert(a() != b());
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+} // namespace tmx::variate
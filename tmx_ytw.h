@@ -0,0 +1,200 @@
+// tmx_ytw.h - Yield to worst.
+// A bond with flows c[j] at u[j] callable at tc[k] for price pc[k] after the
+// coupon paid at tc[k] has one redemption scenario per call date and one to
+// maturity. Scenario k keeps the flows with u[j] <= tc[k] and adds pc[k] at tc[k].
+// Its yield is the constant forward rate y_k with
+//   p = sum_{u[j] <= tc[k]} c[j] exp(-y_k u[j]) + pc[k] exp(-y_k tc[k])
+// Scenarios share flow prefixes so all yields are solved together: each Newton
+// step is one pass over the flows updating the value and derivative of every
+// scenario still holding the flow in a contiguous inner loop.
+#pragma once
+#ifdef _DEBUG
+#include <cassert>
+#include "tmx_analytics.h"
+#endif // _DEBUG
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "ensure.h"
+#include "tmx_math.h"
+#include "tmx_parallel.h"
+
+namespace tmx::ytw {
+
+	template<class U = double, class C = double>
+	struct result {
+		C yield;        // worst yield, NaN if not converged
+		U date;         // redemption date of the worst scenario
+		size_t index;   // call index, or number of calls for maturity
+		bool converged; // false if any scenario yield failed
+	};
+
+	// Yields of the nc + 1 redemption scenarios at price p in y[0..nc], maturity last.
+	// Call dates are increasing and at most the last flow date. Returns the number of Newton
+	// steps, or 0 with every y[k] NaN if some scenario did not converge.
+	template<class U, class C>
+	inline unsigned yields(size_t m, const U* u, const C* c, size_t nc, const U* tc, const C* pc, C p, C* y,
+		C y0 = C(0.01), C tol = math::sqrt_epsilon<C>, unsigned iter = 100)
+	{
+		ensure(m > 0);
+
+		// scenario k holds flows [0, e[k])
+		const size_t K = nc + 1;
+		std::vector<size_t> e(K);
+		for (size_t k = 0; k < nc; ++k) {
+			ensure(k == 0 || tc[k - 1] < tc[k]);
+			ensure(tc[k] <= u[m - 1]);
+			e[k] = std::upper_bound(u, u + m, tc[k]) - u;
+		}
+		e[nc] = m;
+
+		std::fill(y, y + K, y0);
+		std::vector<C> v(K), dv(K);
+		for (unsigned n = 1; n <= iter; ++n) {
+			for (size_t k = 0; k < nc; ++k) {
+				const C x = pc[k] * std::exp(-y[k] * tc[k]);
+				v[k] = x - p;
+				dv[k] = -tc[k] * x;
+			}
+			v[nc] = -p;
+			dv[nc] = 0;
+			// first scenario holding flow j
+			size_t k0 = 0;
+			for (size_t j = 0; j < m; ++j) {
+				while (e[k0] <= j) {
+					++k0;
+				}
+				const U uj = u[j];
+				const C cj = c[j];
+				for (size_t k = k0; k < K; ++k) {
+					const C x = cj * std::exp(-y[k] * uj);
+					v[k] += x;
+					dv[k] -= uj * x;
+				}
+			}
+			C dy = 0;
+			for (size_t k = 0; k < K; ++k) {
+				const C dk = v[k] / dv[k];
+				y[k] -= dk;
+				dy = std::isnan(dk) ? math::infinity<C> : std::max(dy, math::fabs(dk));
+			}
+			if (dy <= tol) {
+				return n;
+			}
+			if (!std::isfinite(dy)) {
+				break; // diverged
+			}
+		}
+		std::fill(y, y + K, math::NaN<C>);
+
+		return 0;
+	}
+
+	// Minimum yield over calls and maturity, earliest on ties. If any scenario fails to
+	// converge the result has NaN yield and date and converged is false.
+	template<class U, class C>
+	inline result<U, C> worst(size_t m, const U* u, const C* c, size_t nc, const U* tc, const C* pc, C p,
+		C y0 = C(0.01), C tol = math::sqrt_epsilon<C>, unsigned iter = 100)
+	{
+		std::vector<C> y(nc + 1);
+		if (0 == yields(m, u, c, nc, tc, pc, p, y.data(), y0, tol, iter)) {
+			return result<U, C>{ math::NaN<C>, math::NaN<U>, nc, false };
+		}
+
+		const size_t k = std::min_element(y.begin(), y.end()) - y.begin();
+
+		return result<U, C>{ y[k], k < nc ? tc[k] : u[m - 1], k, true };
+	}
+
+	// Book of n bonds, bond i has flows u[o[i]..o[i + 1]), c[o[i]..o[i + 1]),
+	// calls tc[oc[i]..oc[i + 1]), pc[oc[i]..oc[i + 1]) and price p[i].
+	template<class U, class C>
+	inline void worst(size_t n, const size_t* o, const U* u, const C* c, const size_t* oc, const U* tc, const C* pc,
+		const C* p, result<U, C>* r, unsigned threads = parallel::concurrency())
+	{
+		parallel::for_each(n, [&](size_t i) {
+			r[i] = worst(o[i + 1] - o[i], u + o[i], c + o[i], oc[i + 1] - oc[i], tc + oc[i], pc + oc[i], p[i]);
+		}, threads, 64);
+	}
+
+#ifdef _DEBUG
+	inline int worst_test()
+	{
+		// 10 year 5% semiannual callable at par on coupon dates from year 5
+		std::vector<double> u(20), c(20, 0.025);
+		for (size_t j = 0; j < 20; ++j) {
+			u[j] = 0.5 * (j + 1);
+		}
+		c.back() += 1;
+		const double tc[] = { 5, 6, 7, 8, 9 };
+		const double pc[] = { 1, 1, 1, 1, 1 };
+
+		// each scenario matches a scalar solve on its truncated flows
+		const auto scalar = [&](size_t k, double p) {
+			if (k == 5) {
+				return analytics::cache<>(20, u.data(), c.data()).yield(p);
+			}
+			const size_t e = std::upper_bound(u.begin(), u.end(), tc[k]) - u.begin();
+			std::vector<double> uk(u.begin(), u.begin() + e), ck(c.begin(), c.begin() + e);
+			ck.back() += pc[k];
+			return analytics::cache<>(e, uk.data(), ck.data()).yield(p);
+		};
+		for (const double p : { 0.9, 1., 1.1 }) {
+			double y[6];
+			const unsigned n = yields(20, u.data(), c.data(), 5, tc, pc, p, y);
+			assert(0 < n && n < 10);
+			for (size_t k = 0; k < 6; ++k) {
+				assert(math::fabs(y[k] - scalar(k, p)) < 1e-12);
+			}
+		}
+		{
+			// premium bond is worst at the first call
+			const auto r = worst(20, u.data(), c.data(), 5, tc, pc, 1.1);
+			assert(0 == r.index && 5 == r.date);
+			// discount bond is worst at maturity
+			const auto s = worst(20, u.data(), c.data(), 5, tc, pc, 0.9);
+			assert(5 == s.index && 10 == s.date);
+			assert(math::fabs(s.yield - scalar(5, 0.9)) < 1e-12);
+			// failures are reported, not taken as the worst scenario
+			const auto x = worst(20, u.data(), c.data(), 5, tc, pc, 1.1, 0.01, 1e-12, 1);
+			assert(!x.converged && std::isnan(x.yield));
+			const auto z = worst(20, u.data(), c.data(), 5, tc, pc, -1.);
+			assert(!z.converged && std::isnan(z.yield));
+			assert(r.converged && s.converged);
+		}
+		{
+			// book
+			const size_t n = 100;
+			std::vector<size_t> o(n + 1, 0), oc(n + 1, 0);
+			std::vector<double> ub, cb, tb, pb, p(n);
+			for (size_t i = 0; i < n; ++i) {
+				const size_t m = 2 * (2 + i % 20);
+				for (size_t j = 0; j < m; ++j) {
+					ub.push_back(0.5 * (j + 1));
+					cb.push_back(0.005 * (1 + i % 9) + (j + 1 == m));
+				}
+				o[i + 1] = o[i] + m;
+				const size_t nc = i % 4;
+				for (size_t k = 0; k < nc; ++k) {
+					tb.push_back(0.5 * (m - 2 * (nc - k)));
+					pb.push_back(1 + 0.01 * (nc - k));
+				}
+				oc[i + 1] = oc[i] + nc;
+				p[i] = 0.95 + 0.001 * i;
+			}
+			std::vector<result<>> r(n);
+			worst(n, o.data(), ub.data(), cb.data(), oc.data(), tb.data(), pb.data(), p.data(), r.data(), 3);
+			for (size_t i = 0; i < n; ++i) {
+				const auto x = worst(o[i + 1] - o[i], ub.data() + o[i], cb.data() + o[i],
+					oc[i + 1] - oc[i], tb.data() + oc[i], pb.data() + oc[i], p[i]);
+				assert(x.converged);
+				assert(r[i].yield == x.yield && r[i].index == x.index);
+				assert(r[i].yield <= analytics::cache<>(o[i + 1] - o[i], ub.data() + o[i], cb.data() + o[i]).yield(p[i]) + 1e-12);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace tmx::ytw